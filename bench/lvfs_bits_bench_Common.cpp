@@ -0,0 +1,227 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bits_bench_Common.h"
+
+#include <lvfs/IEntry>
+#include <lvfs/IStream>
+#include <lvfs/IProperties>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#include <ftw.h>
+#include <time.h>
+
+
+namespace LVFS {
+namespace BitS {
+namespace Bench {
+
+namespace {
+    class Stream : public Implements<IStream>
+    {
+    public:
+        Stream(const std::vector<char> &data) :
+            m_data(data),
+            m_pos(0)
+        {}
+
+    public: /* IStream */
+        virtual size_t read(void *buffer, size_t size)
+        {
+            size = std::min<size_t>(size, m_data.size() - m_pos);
+            ::memcpy(buffer, m_data.data() + m_pos, size);
+            m_pos += size;
+            return size;
+        }
+
+        virtual size_t write(const void *buffer, size_t size) { return 0; }
+        virtual bool advise(off64_t offset, off64_t len, Advise advise) { return false; }
+
+        virtual bool seek(off64_t offset, Whence whence)
+        {
+            const off64_t pos = whence == FromBeginning ? offset : whence == FromCurrent ? m_pos + offset : m_data.size() - offset;
+
+            if (pos < 0 || pos > m_data.size())
+                return false;
+
+            m_pos = pos;
+            return true;
+        }
+
+        virtual bool flush() { return false; }
+        virtual const Error &lastError() const { return m_error; }
+
+    private:
+        const std::vector<char> &m_data;
+        off64_t m_pos;
+        Error m_error;
+    };
+
+
+    /* Not in the "file" schema, so the plugin does not look for local data next to it */
+    class File : public Implements<IEntry, IProperties>
+    {
+    public:
+        File(const std::string &name, const std::vector<char> &data) :
+            m_location("/" + name),
+            m_data(data),
+            m_ctime(::time(NULL))
+        {}
+
+    public: /* IEntry */
+        virtual const char *title() const { return m_location.c_str() + 1; }
+        virtual const char *schema() const { return "bench"; }
+        virtual const char *location() const { return m_location.c_str(); }
+        virtual const IType *type() const { return NULL; }
+        virtual Interface::Holder open(IStream::Mode mode = IStream::Read) const
+        {
+            if (mode != IStream::Read)
+            {
+                m_error = Error(EROFS);
+                return Interface::Holder();
+            }
+
+            return Interface::Holder(new (std::nothrow) Stream(m_data));
+        }
+
+        virtual const Error &lastError() const { return m_error; }
+
+    public: /* IProperties */
+        virtual off64_t size() const { return m_data.size(); }
+        virtual time_t cTime() const { return m_ctime; }
+        virtual time_t mTime() const { return m_ctime; }
+        virtual time_t aTime() const { return m_ctime; }
+        virtual int permissions() const { return Read; }
+
+    private:
+        std::string m_location;
+        const std::vector<char> &m_data;
+        time_t m_ctime;
+        mutable Error m_error;
+    };
+
+
+    static int removeEntry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+    {
+        return ::remove(path);
+    }
+}
+
+
+Arguments::Arguments(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i)
+        if (::strncmp(argv[i], "--", 2) == 0)
+        {
+            const char *value = ::strchr(argv[i], '=');
+
+            if (value == NULL)
+                m_values[argv[i] + 2] = "1";
+            else
+                m_values[std::string(argv[i] + 2, value)] = value + 1;
+        }
+}
+
+int64_t Arguments::integer(const char *name, int64_t value) const
+{
+    std::map<std::string, std::string>::const_iterator i = m_values.find(name);
+    return i == m_values.end() ? value : ::strtoll(i->second.c_str(), NULL, 10);
+}
+
+double Arguments::real(const char *name, double value) const
+{
+    std::map<std::string, std::string>::const_iterator i = m_values.find(name);
+    return i == m_values.end() ? value : ::strtod(i->second.c_str(), NULL);
+}
+
+std::string Arguments::string(const char *name, const char *value) const
+{
+    std::map<std::string, std::string>::const_iterator i = m_values.find(name);
+    return i == m_values.end() ? value : i->second;
+}
+
+std::vector<std::string> Arguments::list(const char *name, const char *value) const
+{
+    const std::string list = string(name, value);
+    std::vector<std::string> res;
+
+    for (std::string::size_type begin = 0, end; begin < list.size(); begin = end + 1)
+    {
+        if ((end = list.find(',', begin)) == std::string::npos)
+            end = list.size();
+
+        if (end > begin)
+            res.push_back(list.substr(begin, end - begin));
+    }
+
+    return res;
+}
+
+Interface::Holder file(const std::string &name, const std::vector<char> &data)
+{
+    return Interface::Holder(new (std::nothrow) File(name, data));
+}
+
+void remove(const std::string &path)
+{
+    ::nftw(path.c_str(), &removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+uint64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double percentile(const std::vector<double> &sorted, double share)
+{
+    if (sorted.empty())
+        return 0;
+
+    return sorted[std::min<size_t>(sorted.size() * share, sorted.size() - 1)];
+}
+
+std::string quote(const std::string &value)
+{
+    std::string res("\"");
+    char buffer[8];
+
+    for (unsigned char c : value)
+        if (c == '"' || c == '\\')
+        {
+            res.push_back('\\');
+            res.push_back(c);
+        }
+        else if (c < 0x20)
+        {
+            ::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            res.append(buffer);
+        }
+        else
+            res.push_back(c);
+
+    res.push_back('"');
+    return res;
+}
+
+}}}
@@ -0,0 +1,70 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BITS_BENCH_COMMON_H_
+#define LVFS_BITS_BENCH_COMMON_H_
+
+#include <lvfs/Interface>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+namespace LVFS {
+namespace BitS {
+namespace Bench {
+
+/* Command line of "--name=value" pairs */
+class Arguments
+{
+public:
+    Arguments(int argc, char *argv[]);
+
+    int64_t integer(const char *name, int64_t value) const;
+    double real(const char *name, double value) const;
+    std::string string(const char *name, const char *value) const;
+
+    /* Comma separated values */
+    std::vector<std::string> list(const char *name, const char *value) const;
+
+private:
+    std::map<std::string, std::string> m_values;
+};
+
+
+/* A read-only file in memory, not in the "file" schema so the plugin does not look for data next to it */
+Interface::Holder file(const std::string &name, const std::vector<char> &data);
+
+/* Removes a file or a directory with everything in it */
+void remove(const std::string &path);
+
+/* Microseconds of a monotonic clock */
+uint64_t now();
+
+/* The value below which the given share of sorted samples falls */
+double percentile(const std::vector<double> &sorted, double share);
+
+/* Writes the string quoted and escaped as a JSON value */
+std::string quote(const std::string &value);
+
+}}}
+
+#endif /* LVFS_BITS_BENCH_COMMON_H_ */
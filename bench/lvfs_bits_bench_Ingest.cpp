@@ -0,0 +1,462 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Metadata ingestion of synthetic multi-file torrents.
+ *
+ *   lvfs-bits-ingest-bench [--files=1,1000,...] [--shapes=wide,deep,balanced]
+ *                          [--depth=N] [--fanout=N] [--file-size=KiB]
+ *                          [--piece-length=KiB]
+ *
+ * Shapes are: "wide", all files in one directory; "deep", files spread
+ * over a chain of --depth nested directories; "balanced", a tree with
+ * --fanout directories per level and up to --fanout files per directory.
+ *
+ * Every case runs in its own process, so peak RSS is of that case only.
+ * Operations are measured one after another on the same TorrentFile:
+ * "list" is TorrentFile::begin() over the root, which parses the whole
+ * .torrent, "enumerate" walks every entry of the tree, and "resolve"
+ * finds the last file of the torrent level by level as a path lookup
+ * does. Each of them reports wall time in milliseconds, operator new
+ * calls and bytes, and ru_maxrss in KiB after it (so it is cumulative).
+ *
+ * "items" is the number of bencoded items of the .torrent, keys of
+ * dictionaries included, lazy_bdecode() refuses those with more than its
+ * default limit of 1M.
+ */
+
+#include "lvfs_bits_bench_Common.h"
+
+#include "lvfs_bits_TorrentFile.h"
+
+#include <lvfs/IEntry>
+#include <lvfs/IDirectory>
+
+#include <libtorrent/create_torrent.hpp>
+#include <libtorrent/bencode.hpp>
+#include <libtorrent/lazy_entry.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+using namespace LVFS;
+using namespace LVFS::BitS;
+using namespace LVFS::BitS::Bench;
+
+namespace {
+    static std::atomic<uint64_t> allocations(0);
+    static std::atomic<uint64_t> allocated(0);
+
+    static inline void *allocate(size_t size)
+    {
+        ++allocations;
+        allocated += size;
+        return ::malloc(size == 0 ? 1 : size);
+    }
+}
+
+
+/* Counts allocations of the whole process, libtorrent and LVFS included */
+void *operator new(size_t size)
+{
+    if (void *res = allocate(size))
+        return res;
+
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    ::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    ::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    ::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    ::free(ptr);
+}
+
+
+namespace {
+    struct Shape
+    {
+        std::string name;
+        int files;
+        int depth;
+        int fanout;
+    };
+
+    struct Sample
+    {
+        Sample() :
+            start(now()),
+            allocations(::allocations),
+            allocated(::allocated)
+        {}
+
+        void print(const char *name) const
+        {
+            struct rusage usage;
+            ::getrusage(RUSAGE_SELF, &usage);
+
+            ::printf(", \"%s\": {\"ms\": %.3f, \"allocations\": %llu, \"bytes\": %llu, \"max_rss_kb\": %ld}",
+                     name,
+                     (now() - start) / 1000.0,
+                     static_cast<unsigned long long>(::allocations - allocations),
+                     static_cast<unsigned long long>(::allocated - allocated),
+                     usage.ru_maxrss);
+        }
+
+        uint64_t start;
+        uint64_t allocations;
+        uint64_t allocated;
+    };
+
+
+    /* Directories of a file, files of one directory go one after another */
+    static std::vector<std::string> directories(const Shape &shape, int index)
+    {
+        std::vector<std::string> res;
+        char buf[32];
+
+        if (shape.name == "deep")
+        {
+            const int level = static_cast<int64_t>(index) * shape.depth / shape.files;
+
+            for (int i = 0; i <= level; ++i)
+            {
+                ::snprintf(buf, sizeof(buf), "d%03d", i);
+                res.push_back(buf);
+            }
+        }
+        else if (shape.name == "balanced")
+        {
+            int levels = 0;
+
+            for (int64_t capacity = shape.fanout; capacity < shape.files; capacity *= shape.fanout)
+                ++levels;
+
+            for (int i = 0, dir = index / shape.fanout; i < levels; ++i, dir /= shape.fanout)
+            {
+                ::snprintf(buf, sizeof(buf), "d%03d", dir % shape.fanout);
+                res.insert(res.begin(), buf);
+            }
+        }
+
+        return res;
+    }
+
+    static std::string fileName(int index)
+    {
+        char buf[32];
+        ::snprintf(buf, sizeof(buf), "f%07d", index);
+        return buf;
+    }
+
+    static bool generate(const Shape &shape, int64_t file_size, int piece_length, std::vector<char> &torrent)
+    {
+        using namespace libtorrent;
+
+        file_storage fs;
+
+        for (int i = 0; i < shape.files; ++i)
+        {
+            std::string path("ingest");
+
+            for (const std::string &dir : directories(shape, i))
+                path.append("/").append(dir);
+
+            fs.add_file(path.append("/").append(fileName(i)), file_size);
+        }
+
+        create_torrent ct(fs, piece_length, -1, 0);
+
+        /* Nobody downloads it, hashes of pieces are never checked */
+        for (int i = 0; i < ct.num_pieces(); ++i)
+            ct.set_hash(i, sha1_hash());
+
+        bencode(std::back_inserter(torrent), ct.generate());
+        return true;
+    }
+
+    static int64_t items(const libtorrent::lazy_entry &entry)
+    {
+        int64_t res = 1;
+
+        if (entry.type() == libtorrent::lazy_entry::dict_t)
+            for (int i = 0; i < entry.dict_size(); ++i)
+                res += 1 + items(*entry.dict_at(i).second);
+        else if (entry.type() == libtorrent::lazy_entry::list_t)
+            for (int i = 0; i < entry.list_size(); ++i)
+                res += items(*entry.list_at(i));
+
+        return res;
+    }
+
+    static int64_t enumerate(const IDirectory *dir)
+    {
+        int64_t res = 0;
+
+        for (IDirectory::const_iterator i = dir->begin(), end = dir->end(); i != end; ++i)
+        {
+            ++res;
+
+            if (const IDirectory *sub = (*i)->as<IDirectory>())
+                res += enumerate(sub);
+        }
+
+        return res;
+    }
+
+    static bool resolve(const IDirectory *dir, const std::vector<std::string> &path)
+    {
+        for (int level = 0; level < path.size(); ++level)
+        {
+            const IDirectory *next = NULL;
+
+            for (IDirectory::const_iterator i = dir->begin(), end = dir->end(); i != end; ++i)
+                if (path[level] == (*i)->as<IEntry>()->title())
+                {
+                    if (level + 1 == path.size())
+                        return true;
+
+                    next = (*i)->as<IDirectory>();
+                    break;
+                }
+
+            if (next == NULL)
+                return false;
+
+            dir = next;
+        }
+
+        return false;
+    }
+
+    static void measure(const Shape &shape, const std::vector<char> &torrent)
+    {
+        std::vector<std::string> path(1, "ingest");
+        const std::vector<std::string> dirs = directories(shape, shape.files - 1);
+        path.insert(path.end(), dirs.begin(), dirs.end());
+        path.push_back(fileName(shape.files - 1));
+
+        ::printf("{\"shape\": %s, \"files\": %d, \"depth\": %d, \"size\": %llu",
+                 quote(shape.name).c_str(),
+                 shape.files,
+                 static_cast<int>(path.size()) - 1,
+                 static_cast<unsigned long long>(torrent.size()));
+
+        Interface::Holder dir(new (std::nothrow) TorrentFile(file("ingest.torrent", torrent)));
+        int64_t entries = 0;
+        bool found = false;
+
+        {
+            Sample sample;
+            const IDirectory *root = dir->as<IDirectory>();
+
+            for (IDirectory::const_iterator i = root->begin(), end = root->end(); i != end; ++i)
+                ++entries;
+
+            sample.print("list");
+        }
+
+        {
+            Sample sample;
+            entries = enumerate(dir->as<IDirectory>());
+            sample.print("enumerate");
+        }
+
+        {
+            Sample sample;
+            found = resolve(dir->as<IDirectory>(), path);
+            sample.print("resolve");
+        }
+
+        libtorrent::lazy_entry e;
+        libtorrent::error_code ec;
+        int64_t count = -1;
+
+        if (libtorrent::lazy_bdecode(torrent.data(), torrent.data() + torrent.size(), e, ec, NULL, 1000, 100 * 1000 * 1000) == 0)
+            count = items(e);
+
+        ::printf(", \"entries\": %lld, \"resolved\": %s, \"items\": %lld, \"default_bdecode_limit\": %s}",
+                 static_cast<long long>(entries),
+                 found ? "true" : "false",
+                 static_cast<long long>(count),
+                 count >= 0 && count <= 1000000 ? "true" : "false");
+    }
+
+    /*
+     * Generation gets a process of its own too, so it does not add to the RSS
+     * of the measurement. The measurement prints into a pipe, so a case which
+     * fails half way through leaves nothing on stdout.
+     */
+    static bool run(const Shape &shape, int64_t file_size, int piece_length, const std::string &file_name, std::string &result)
+    {
+        pid_t pid = ::fork();
+
+        if (pid == 0)
+        {
+            std::vector<char> torrent;
+            FILE *file;
+
+            if (!generate(shape, file_size, piece_length, torrent) || (file = ::fopen(file_name.c_str(), "wb")) == NULL)
+                ::_exit(1);
+
+            const bool ok = ::fwrite(torrent.data(), 1, torrent.size(), file) == torrent.size();
+            ::fclose(file);
+            ::_exit(ok ? 0 : 1);
+        }
+
+        int status;
+
+        if (pid < 0 || ::waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            return false;
+
+        int fds[2];
+
+        if (::pipe(fds) != 0)
+            return false;
+
+        if ((pid = ::fork()) == 0)
+        {
+            std::vector<char> torrent;
+            FILE *file = ::fopen(file_name.c_str(), "rb");
+            char buf[65536];
+            size_t len;
+
+            ::close(fds[0]);
+
+            if (file == NULL || ::dup2(fds[1], STDOUT_FILENO) == -1)
+                ::_exit(1);
+
+            while ((len = ::fread(buf, 1, sizeof(buf), file)) > 0)
+                torrent.insert(torrent.end(), buf, buf + len);
+
+            ::fclose(file);
+
+            measure(shape, torrent);
+            ::fflush(stdout);
+            ::_exit(0);
+        }
+
+        char buf[4096];
+        ssize_t len;
+
+        ::close(fds[1]);
+        result.clear();
+
+        while ((len = ::read(fds[0], buf, sizeof(buf))) != 0)
+            if (len > 0)
+                result.append(buf, len);
+            else if (errno != EINTR)
+                break;
+
+        ::close(fds[0]);
+
+        const bool ok = pid > 0 && ::waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        ::unlink(file_name.c_str());
+        return ok;
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    const Arguments args(argc, argv);
+
+    const std::vector<std::string> counts = args.list("files", "1,1000,10000,100000,1000000");
+    const std::vector<std::string> shapes = args.list("shapes", "wide,deep,balanced");
+    const int depth = std::max<int64_t>(args.integer("depth", 64), 1);
+    const int fanout = std::max<int64_t>(args.integer("fanout", 16), 2);
+    const int64_t file_size = std::max<int64_t>(args.integer("file-size", 1), 1) * 1024;
+    const int piece_length = args.integer("piece-length", 256) * 1024;
+
+    char file_name[64];
+    ::snprintf(file_name, sizeof(file_name), "/tmp/lvfs-bits-ingest.%d.torrent", ::getpid());
+
+    bool first = true;
+    int res = 0;
+
+    /* Children of run() must not inherit anything buffered */
+    ::printf("[");
+    ::fflush(stdout);
+
+    for (const std::string &name : shapes)
+        for (const std::string &count : counts)
+        {
+            const Shape shape = { name, std::max(::atoi(count.c_str()), 1), depth, fanout };
+
+            std::string result;
+            const bool ok = run(shape, file_size, piece_length, file_name, result);
+
+            ::printf(first ? "\n  " : ",\n  ");
+            first = false;
+
+            if (ok)
+                ::printf("%s", result.c_str());
+            else
+            {
+                ::fprintf(stderr, "Failed to ingest %d files of \"%s\" shape\n", shape.files, name.c_str());
+                ::printf("{\"shape\": %s, \"files\": %d, \"failed\": true}", quote(name).c_str(), shape.files);
+                res = 1;
+            }
+
+            ::fflush(stdout);
+        }
+
+    ::printf("\n]\n");
+    return res;
+}
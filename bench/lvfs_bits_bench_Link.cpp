@@ -0,0 +1,277 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bits_bench_Link.h"
+
+#include <new>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+
+namespace LVFS {
+namespace BitS {
+namespace Bench {
+
+namespace {
+    enum
+    {
+        ChunkSize = 64 * 1024
+    };
+
+
+    static int connectTo(int port)
+    {
+        struct sockaddr_in addr;
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+
+        if (fd == -1)
+            return -1;
+
+        ::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+
+        /* Delays are made by the link, not by Nagle */
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+}
+
+
+Link::Link(int target, int round_trip) :
+    m_target(target),
+    m_delay(std::chrono::microseconds(round_trip * 1000 / 2)),
+    m_port(0),
+    m_listener(-1),
+    m_stop(false)
+{}
+
+Link::~Link()
+{
+    m_stop = true;
+
+    if (m_listener != -1)
+    {
+        /* Wakes up accept() */
+        ::shutdown(m_listener, SHUT_RDWR);
+
+        if (m_thread.joinable())
+            m_thread.join();
+
+        ::close(m_listener);
+    }
+
+    for (int fd : m_sockets)
+        ::shutdown(fd, SHUT_RDWR);
+
+    for (Pipe *pipe : m_pipes)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pipe->mutex);
+            pipe->closed = true;
+        }
+
+        pipe->condition.notify_one();
+        pipe->reader.join();
+        pipe->writer.join();
+        delete pipe;
+    }
+
+    for (int fd : m_sockets)
+        ::close(fd);
+}
+
+bool Link::start()
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int one = 1;
+
+    if ((m_listener = ::socket(AF_INET, SOCK_STREAM, 0)) == -1)
+        return false;
+
+    ::setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (::bind(m_listener, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        ::listen(m_listener, SOMAXCONN) != 0 ||
+        ::getsockname(m_listener, reinterpret_cast<struct sockaddr *>(&addr), &len) != 0)
+        return false;
+
+    m_port = ntohs(addr.sin_port);
+    m_thread = std::thread(&Link::accept, this);
+
+    return true;
+}
+
+void Link::accept()
+{
+    while (!m_stop)
+    {
+        int client = ::accept(m_listener, NULL, NULL);
+
+        if (client == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        int server = connectTo(m_target);
+
+        if (server == -1)
+        {
+            ::close(client);
+            continue;
+        }
+
+        int one = 1;
+        ::setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_stop)
+        {
+            ::close(client);
+            ::close(server);
+            break;
+        }
+
+        m_sockets.push_back(client);
+        m_sockets.push_back(server);
+
+        const int ends[2][2] = { { client, server }, { server, client } };
+
+        for (int i = 0; i < 2; ++i)
+        {
+            Pipe *pipe = new (std::nothrow) Pipe;
+
+            if (pipe == NULL)
+            {
+                ::shutdown(client, SHUT_RDWR);
+                ::shutdown(server, SHUT_RDWR);
+                break;
+            }
+
+            pipe->from = ends[i][0];
+            pipe->to = ends[i][1];
+            pipe->closed = false;
+            pipe->reader = std::thread(&Link::receive, this, std::ref(*pipe));
+            pipe->writer = std::thread(&Link::send, this, std::ref(*pipe));
+
+            m_pipes.push_back(pipe);
+        }
+    }
+}
+
+void Link::receive(Pipe &pipe)
+{
+    for (;;)
+    {
+        Chunk chunk = { Clock::time_point(), std::vector<char>(ChunkSize) };
+        const ssize_t res = ::read(pipe.from, chunk.data.data(), chunk.data.size());
+
+        if (res < 0 && errno == EINTR)
+            continue;
+
+        std::lock_guard<std::mutex> lock(pipe.mutex);
+
+        if (res <= 0)
+        {
+            pipe.closed = true;
+            pipe.condition.notify_one();
+            break;
+        }
+
+        chunk.due = Clock::now() + m_delay;
+        chunk.data.resize(res);
+        pipe.chunks.push_back(std::move(chunk));
+        pipe.condition.notify_one();
+    }
+}
+
+void Link::send(Pipe &pipe)
+{
+    std::unique_lock<std::mutex> lock(pipe.mutex);
+
+    for (;;)
+    {
+        if (pipe.chunks.empty())
+        {
+            if (pipe.closed)
+                break;
+
+            pipe.condition.wait(lock);
+            continue;
+        }
+
+        /* Chunks are due in the order they came */
+        if (Clock::now() < pipe.chunks.front().due)
+        {
+            pipe.condition.wait_until(lock, pipe.chunks.front().due);
+            continue;
+        }
+
+        Chunk chunk = std::move(pipe.chunks.front());
+        pipe.chunks.pop_front();
+        lock.unlock();
+
+        for (size_t done = 0; done < chunk.data.size();)
+        {
+            const ssize_t res = ::send(pipe.to, chunk.data.data() + done, chunk.data.size() - done, MSG_NOSIGNAL);
+
+            if (res < 0 && errno == EINTR)
+                continue;
+
+            if (res <= 0)
+            {
+                /* The other end is gone, so is this direction */
+                ::shutdown(pipe.from, SHUT_RD);
+                return;
+            }
+
+            done += res;
+        }
+
+        lock.lock();
+    }
+
+    ::shutdown(pipe.to, SHUT_WR);
+}
+
+}}}
@@ -0,0 +1,101 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BITS_BENCH_LINK_H_
+#define LVFS_BITS_BENCH_LINK_H_
+
+#include <lvfs/Interface>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace LVFS {
+namespace BitS {
+namespace Bench {
+
+/**
+ * TCP proxy on loopback adding latency.
+ *
+ * Connections to port() are forwarded to the target port, and every
+ * chunk of data is delivered half of the round trip time after it was
+ * received, in both directions. Bandwidth is not limited here, it is up
+ * to the ends of the link.
+ */
+class Link
+{
+    PLATFORM_MAKE_NONCOPYABLE(Link)
+    PLATFORM_MAKE_NONMOVEABLE(Link)
+
+public:
+    typedef std::chrono::steady_clock Clock;
+
+public:
+    Link(int target, int round_trip);
+    ~Link();
+
+    /* Listens on an ephemeral port of 127.0.0.1 */
+    bool start();
+
+    int port() const { return m_port; }
+
+private:
+    struct Chunk
+    {
+        Clock::time_point due;
+        std::vector<char> data;
+    };
+
+    struct Pipe
+    {
+        int from;
+        int to;
+        bool closed;
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::deque<Chunk> chunks;
+        std::thread reader;
+        std::thread writer;
+    };
+
+private:
+    void accept();
+    void receive(Pipe &pipe);
+    void send(Pipe &pipe);
+
+private:
+    int m_target;
+    Clock::duration m_delay;
+    int m_port;
+    int m_listener;
+    std::atomic<bool> m_stop;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::vector<int> m_sockets;
+    std::vector<Pipe *> m_pipes;
+};
+
+}}}
+
+#endif /* LVFS_BITS_BENCH_LINK_H_ */
@@ -0,0 +1,461 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Replays a trace recorded with Options::trace against seeders on
+ * loopback.
+ *
+ *   lvfs-bits-replay --trace=FILE [--seeders=N] [--port=N] [--rate=KiB/s]
+ *                    [--rtt=ms] [--speed=X] [--memory]
+ *
+ * Every torrent of the trace is replaced by a synthetic one with the
+ * same piece length and the same sizes of the files which were opened,
+ * files never opened are one piece long. The seeders upload at most at
+ * --rate each, and --rtt adds that round trip time to every connection
+ * to them, so the same trace and the same options give the same run.
+ *
+ * Every stream is replayed by its own thread at the recorded times,
+ * scaled by --speed. A call which is late because the previous one took
+ * longer than it did when recorded starts right away, the lag is
+ * reported. Opens which failed when recorded are counted, not replayed.
+ *
+ * The result is one JSON object on stdout, times are in milliseconds.
+ */
+
+#include "lvfs_bits_bench_Common.h"
+#include "lvfs_bits_bench_Swarm.h"
+
+#include "lvfs_bits_TorrentFile.h"
+#include "lvfs_bits_Session.h"
+
+#include <lvfs/IEntry>
+#include <lvfs/IStream>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
+
+using namespace LVFS;
+using namespace LVFS::BitS;
+using namespace LVFS::BitS::Bench;
+
+namespace {
+    struct Event
+    {
+        enum Type
+        {
+            Read,
+            Seek,
+            Advise
+        };
+
+        Type type;
+        uint64_t time;
+        int64_t offset;
+        int64_t length;
+        int mode;
+        int64_t position;
+        uint64_t duration;
+    };
+
+    struct Reader
+    {
+        uint64_t opened;
+        std::string hash;
+        int file;
+        std::vector<Event> events;
+        uint64_t closed;
+    };
+
+    struct Source
+    {
+        int pieceLength;
+        std::map<int, int64_t> files;
+        const Swarm::Content *content;
+        Interface::Holder file;
+        std::vector<Interface::Holder> entries;
+    };
+
+    struct Recording
+    {
+        Recording() :
+            epoch(0),
+            failedOpens(0)
+        {}
+
+        std::string run;
+        int64_t epoch;
+        std::map<uint32_t, Reader> readers;
+        std::map<std::string, Source> sources;
+        std::vector<std::string> order;
+        int failedOpens;
+    };
+
+    struct Result
+    {
+        Result() :
+            bytes(0),
+            errors(0),
+            openErrors(0),
+            resyncs(0),
+            lag(0)
+        {}
+
+        uint64_t bytes;
+        uint64_t errors;
+        uint64_t openErrors;
+        uint64_t resyncs;
+        double lag;
+        std::vector<double> recorded;
+        std::vector<double> replayed;
+    };
+
+
+    static bool parse(const char *name, Recording &trace)
+    {
+        FILE *file = ::fopen(name, "r");
+        char line[512];
+        char run[64];
+        char type[16];
+        uint64_t time;
+        uint32_t id;
+
+        if (file == NULL)
+            return false;
+
+        if (::fgets(line, sizeof(line), file) == NULL ||
+            ::sscanf(line, "0 run %63s %" SCNd64, run, &trace.epoch) != 2)
+        {
+            ::fclose(file);
+            return false;
+        }
+
+        trace.run = run;
+
+        while (::fgets(line, sizeof(line), file) != NULL)
+        {
+            if (::sscanf(line, "%" SCNu64 " %15s %" SCNu32, &time, type, &id) != 3)
+                continue;
+
+            if (::strcmp(type, "open") == 0)
+            {
+                char hash[41];
+                int index;
+                int64_t size;
+                int piece_length;
+                int result;
+
+                if (::sscanf(line, "%*s open %*s %40s %d %" SCNd64 " %d %d", hash, &index, &size, &piece_length, &result) != 5 ||
+                    index < 0 || size < 0 || piece_length <= 0)
+                    continue;
+
+                if (result == 0)
+                {
+                    ++trace.failedOpens;
+                    continue;
+                }
+
+                Reader reader = { time, hash, index, std::vector<Event>(), time };
+                trace.readers[id] = reader;
+
+                if (trace.sources.find(hash) == trace.sources.end())
+                {
+                    trace.order.push_back(hash);
+                    trace.sources[hash].pieceLength = piece_length;
+                    trace.sources[hash].content = NULL;
+                }
+
+                trace.sources[hash].files[index] = size;
+                continue;
+            }
+
+            std::map<uint32_t, Reader>::iterator reader = trace.readers.find(id);
+
+            if (reader == trace.readers.end())
+                continue;
+
+            Event event = { Event::Read, time, 0, 0, 0, 0, 0 };
+            long long size;
+            int mode;
+
+            if (::strcmp(type, "read") == 0 &&
+                ::sscanf(line, "%*s read %*s %" SCNd64 " %lld %*s %" SCNu64, &event.offset, &size, &event.duration) == 3)
+                event.length = size;
+            else if (::strcmp(type, "seek") == 0 &&
+                     ::sscanf(line, "%*s seek %*s %" SCNd64 " %d %" SCNd64, &event.offset, &mode, &event.position) == 3)
+            {
+                event.type = Event::Seek;
+                event.mode = mode;
+            }
+            else if (::strcmp(type, "advise") == 0 &&
+                     ::sscanf(line, "%*s advise %*s %" SCNd64 " %lld %d", &event.offset, &size, &mode) == 3)
+            {
+                event.type = Event::Advise;
+                event.length = size;
+                event.mode = mode;
+            }
+            else
+            {
+                if (::strcmp(type, "close") == 0)
+                    reader->second.closed = time;
+
+                continue;
+            }
+
+            reader->second.events.push_back(event);
+        }
+
+        ::fclose(file);
+        return true;
+    }
+
+    static void wait(uint64_t start, uint64_t time, double speed, double &lag)
+    {
+        const uint64_t due = start + static_cast<uint64_t>(time / speed);
+        const uint64_t current = now();
+
+        if (current < due)
+            std::this_thread::sleep_for(std::chrono::microseconds(due - current));
+        else
+            lag = std::max(lag, (current - due) / 1000.0);
+    }
+
+    static void replay(const Reader &reader, const Source &source, uint64_t start, double speed, Result &result, std::mutex &mutex)
+    {
+        std::vector<char> buffer;
+        Result local;
+
+        wait(start, reader.opened, speed, local.lag);
+        Interface::Holder file = source.entries[reader.file]->as<IEntry>()->open(IStream::Read);
+
+        if (!file.isValid())
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++result.openErrors;
+            return;
+        }
+
+        IStream *fp = file->as<IStream>();
+        int64_t pos = 0;
+
+        for (const Event &event : reader.events)
+        {
+            wait(start, event.time, speed, local.lag);
+
+            switch (event.type)
+            {
+                case Event::Read:
+                {
+                    /* A read which got less than when recorded moves the position elsewhere */
+                    if (pos != event.offset)
+                    {
+                        ++local.resyncs;
+
+                        if (!fp->seek(event.offset, IStream::FromBeginning))
+                        {
+                            ++local.errors;
+                            break;
+                        }
+                    }
+
+                    buffer.resize(event.length);
+
+                    const uint64_t begin = now();
+                    const size_t res = fp->read(buffer.data(), buffer.size());
+
+                    local.replayed.push_back((now() - begin) / 1000.0);
+                    local.recorded.push_back(event.duration / 1000.0);
+                    local.bytes += res;
+                    pos = event.offset + res;
+
+                    if (!source.content->check(reader.file, event.offset, buffer.data(), res))
+                        ++local.errors;
+
+                    break;
+                }
+
+                case Event::Seek:
+                    /* The stream had computed the position, it is taken as recorded */
+                    if (fp->seek(event.offset, static_cast<IStream::Whence>(event.mode)))
+                        pos = event.position;
+
+                    break;
+
+                case Event::Advise:
+                    fp->advise(event.offset, event.length, static_cast<IStream::Advise>(event.mode));
+                    break;
+            }
+        }
+
+        wait(start, reader.closed, speed, local.lag);
+        file.reset();
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        result.bytes += local.bytes;
+        result.errors += local.errors;
+        result.resyncs += local.resyncs;
+        result.lag = std::max(result.lag, local.lag);
+        result.recorded.insert(result.recorded.end(), local.recorded.begin(), local.recorded.end());
+        result.replayed.insert(result.replayed.end(), local.replayed.begin(), local.replayed.end());
+    }
+
+    static std::string latencies(std::vector<double> &values)
+    {
+        char buffer[256];
+
+        std::sort(values.begin(), values.end());
+        ::snprintf(buffer, sizeof(buffer), "{\"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f}",
+                   percentile(values, 0.5),
+                   percentile(values, 0.9),
+                   percentile(values, 0.99),
+                   values.empty() ? 0.0 : values.back());
+
+        return buffer;
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    const Arguments args(argc, argv);
+
+    const std::string trace_name = args.string("trace", "");
+    const int seeders = std::max<int64_t>(args.integer("seeders", 1), 1);
+    const int port = args.integer("port", 53000);
+    const int rate = args.integer("rate", 0) * 1024;
+    const int rtt = std::max<int64_t>(args.integer("rtt", 0), 0);
+    const double speed = std::max(args.real("speed", 1.0), 0.001);
+    const bool memory = args.integer("memory", 0) != 0;
+
+    Recording trace;
+
+    if (trace_name.empty() || !parse(trace_name.c_str(), trace))
+    {
+        ::fprintf(stderr, "Failed to read the trace \"%s\"\n", trace_name.c_str());
+        return 1;
+    }
+
+    char root[64];
+    ::snprintf(root, sizeof(root), "/tmp/lvfs-bits-replay.%d", ::getpid());
+
+    Swarm swarm(std::string(root) + "-seed", seeders, port);
+
+    if (!swarm.start() || !swarm.shape(rate, rtt) || !configure(swarm.peers(), port + seeders, std::string(root) + "-resume", memory))
+    {
+        ::fprintf(stderr, "Failed to start the seeders\n");
+        return 1;
+    }
+
+    std::vector<std::string> downloads;
+
+    for (int t = 0; t < trace.order.size(); ++t)
+    {
+        Source &source = trace.sources[trace.order[t]];
+        std::vector<int64_t> sizes(source.files.rbegin()->first + 1, source.pieceLength);
+        char name[64];
+
+        for (const std::pair<const int, int64_t> &file : source.files)
+            sizes[file.first] = file.second;
+
+        ::snprintf(name, sizeof(name), "lvfs-bits-replay-%d-%d", ::getpid(), t);
+
+        if ((source.content = swarm.add(name, sizes, source.pieceLength, t + 1)) == NULL)
+        {
+            ::fprintf(stderr, "Failed to create the torrent of %s\n", trace.order[t].c_str());
+            return 1;
+        }
+
+        downloads.push_back(std::string("/tmp/") + name);
+        source.file.reset(new (std::nothrow) TorrentFile(source.content->open()));
+
+        if (!source.content->entries(source.file, source.entries))
+        {
+            ::fprintf(stderr, "Failed to list the torrent of %s\n", trace.order[t].c_str());
+            return 1;
+        }
+    }
+
+    Result result;
+    std::mutex mutex;
+    std::vector<std::thread> workers;
+    const uint64_t start = now();
+
+    for (const std::pair<const uint32_t, Reader> &reader : trace.readers)
+        workers.push_back(std::thread(&replay,
+                                      std::cref(reader.second),
+                                      std::cref(trace.sources[reader.second.hash]),
+                                      start,
+                                      speed,
+                                      std::ref(result),
+                                      std::ref(mutex)));
+
+    for (std::thread &worker : workers)
+        worker.join();
+
+    const double seconds = (now() - start) / 1000000.0;
+    const size_t reads = result.replayed.size();
+    const std::string recorded = latencies(result.recorded);
+    const std::string replayed = latencies(result.replayed);
+
+    ::printf("{\"run\": %s, \"epoch\": %lld, \"torrents\": %zu, \"streams\": %zu, \"failed_opens\": %d, "
+             "\"seeders\": %d, \"rate\": %d, \"rtt_ms\": %d, \"speed\": %.3f, \"memory\": %s, "
+             "\"seconds\": %.3f, \"reads\": %zu, \"bytes\": %llu, \"open_errors\": %llu, \"errors\": %llu, "
+             "\"resyncs\": %llu, \"max_lag_ms\": %.3f, \"recorded\": %s, \"replayed\": %s}\n",
+             quote(trace.run).c_str(),
+             static_cast<long long>(trace.epoch),
+             trace.sources.size(),
+             trace.readers.size(),
+             trace.failedOpens,
+             seeders,
+             rate,
+             rtt,
+             speed,
+             memory ? "true" : "false",
+             seconds,
+             reads,
+             static_cast<unsigned long long>(result.bytes),
+             static_cast<unsigned long long>(result.openErrors),
+             static_cast<unsigned long long>(result.errors),
+             static_cast<unsigned long long>(result.resyncs),
+             result.lag,
+             recorded.c_str(),
+             replayed.c_str());
+
+    /* Entries of the torrents hold the session */
+    trace.sources.clear();
+
+    Session::shutdown();
+
+    for (const std::string &download : downloads)
+        remove(download);
+
+    remove(std::string(root) + "-resume");
+    return result.errors == 0 && result.openErrors == 0 ? 0 : 1;
+}
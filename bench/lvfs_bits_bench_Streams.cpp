@@ -0,0 +1,339 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Throughput and latency of streams of the plugin downloading from
+ * seeders on loopback.
+ *
+ *   lvfs-bits-bench [--size=MiB] [--piece-length=KiB] [--files=N]
+ *                   [--seeders=N] [--port=N] [--block=KiB] [--stride=KiB]
+ *                   [--reads=N] [--threads=N] [--memory]
+ *                   [--workloads=sequential,strided,random,concurrent]
+ *
+ * Every workload gets a new torrent, so nothing is downloaded already.
+ * The results are printed to stdout as a JSON array, one object per
+ * workload. Times are in milliseconds, ttfb is measured from opening a
+ * stream to its first read returning, and for concurrent readers it is
+ * the slowest of them. Latencies are of single IStream::read() calls.
+ */
+
+#include "lvfs_bits_bench_Common.h"
+#include "lvfs_bits_bench_Swarm.h"
+
+#include "lvfs_bits_TorrentFile.h"
+#include "lvfs_bits_Session.h"
+
+#include <lvfs/IEntry>
+#include <lvfs/IStream>
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
+
+using namespace LVFS;
+using namespace LVFS::BitS;
+using namespace LVFS::BitS::Bench;
+
+namespace {
+    struct Read
+    {
+        int64_t offset;
+        size_t size;
+    };
+
+    struct Job
+    {
+        Interface::Holder entry;
+        int file;
+        std::vector<Read> reads;
+    };
+
+    struct Result
+    {
+        Result() :
+            bytes(0),
+            ttfb(0),
+            deadlineMisses(0),
+            timeouts(0),
+            errors(0)
+        {}
+
+        uint64_t bytes;
+        double ttfb;
+        std::vector<double> latencies;
+        uint64_t deadlineMisses;
+        uint64_t timeouts;
+        uint64_t errors;
+    };
+
+
+    static void run(const Job &job, const Swarm::Content &content, Result &result, std::mutex &mutex)
+    {
+        std::vector<char> buffer;
+        std::vector<double> latencies;
+        Result local;
+
+        const uint64_t opened = now();
+        Interface::Holder stream = job.entry->as<IEntry>()->open(IStream::Read);
+
+        if (!stream.isValid())
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++result.errors;
+            return;
+        }
+
+        int64_t pos = 0;
+
+        for (const Read &read : job.reads)
+        {
+            buffer.resize(read.size);
+
+            if (read.offset != pos && !stream->as<IStream>()->seek(read.offset, IStream::FromBeginning))
+            {
+                ++local.errors;
+                break;
+            }
+
+            const uint64_t start = now();
+            const size_t res = stream->as<IStream>()->read(buffer.data(), read.size);
+            const uint64_t end = now();
+
+            if (local.latencies.empty())
+                local.ttfb = (end - opened) / 1000.0;
+
+            local.latencies.push_back((end - start) / 1000.0);
+            local.bytes += res;
+            pos = read.offset + res;
+
+            if (res != read.size || !content.check(job.file, read.offset, buffer.data(), res))
+                ++local.errors;
+        }
+
+        IStatistics::Snapshot snapshot;
+
+        if (IStatistics *statistics = stream->as<IStatistics>())
+            if (statistics->statistics(snapshot, IStatistics::StreamScope))
+            {
+                local.deadlineMisses = snapshot.deadlineMisses;
+                local.timeouts = snapshot.timeouts;
+            }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        result.bytes += local.bytes;
+        result.ttfb = std::max(result.ttfb, local.ttfb);
+        result.latencies.insert(result.latencies.end(), local.latencies.begin(), local.latencies.end());
+        result.deadlineMisses += local.deadlineMisses;
+        result.timeouts += local.timeouts;
+        result.errors += local.errors;
+    }
+
+    static void sequential(std::vector<Read> &reads, int64_t begin, int64_t end, int64_t block, int64_t gap)
+    {
+        for (int64_t offset = begin; offset < end; offset += block + gap)
+        {
+            Read read = { offset, static_cast<size_t>(std::min(block, end - offset)) };
+            reads.push_back(read);
+        }
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    const Arguments args(argc, argv);
+
+    const int64_t size = args.integer("size", 256) * 1024 * 1024;
+    const int piece_length = args.integer("piece-length", 256) * 1024;
+    const int files = std::max<int64_t>(args.integer("files", 1), 1);
+    const int seeders = std::max<int64_t>(args.integer("seeders", 1), 1);
+    const int port = args.integer("port", 52000);
+    const int64_t block = args.integer("block", 64) * 1024;
+    const int64_t stride = args.integer("stride", 1024) * 1024;
+    const int reads = args.integer("reads", 256);
+    const int threads = std::max<int64_t>(args.integer("threads", 4), 1);
+    const bool memory = args.integer("memory", 0) != 0;
+    const std::vector<std::string> workloads = args.list("workloads", "sequential,strided,random,concurrent");
+
+    char root[64];
+    ::snprintf(root, sizeof(root), "/tmp/lvfs-bits-bench.%d", ::getpid());
+
+    Swarm swarm(std::string(root) + "-seed", seeders, port);
+
+    if (!swarm.start() || !configure(swarm.peers(), port + seeders, std::string(root) + "-resume", memory))
+    {
+        ::fprintf(stderr, "Failed to start the seeders\n");
+        return 1;
+    }
+
+    std::vector<std::string> downloads;
+    std::vector<int64_t> sizes(files, size / files);
+    sizes.back() += size % files;
+
+    ::printf("[");
+
+    for (int w = 0; w < workloads.size(); ++w)
+    {
+        const std::string &workload = workloads[w];
+        char name[64];
+
+        ::snprintf(name, sizeof(name), "lvfs-bits-bench-%d-%d", ::getpid(), w);
+        const Swarm::Content *content = swarm.add(name, sizes, piece_length, w + 1);
+
+        if (content == NULL)
+        {
+            ::fprintf(stderr, "Failed to create the torrent of \"%s\"\n", workload.c_str());
+            return 1;
+        }
+
+        downloads.push_back(std::string("/tmp/") + name);
+
+        Interface::Holder torrent(new (std::nothrow) TorrentFile(content->open()));
+        std::vector<Interface::Holder> entries;
+
+        if (!content->entries(torrent, entries))
+        {
+            ::fprintf(stderr, "Failed to list the torrent of \"%s\"\n", workload.c_str());
+            return 1;
+        }
+
+        std::vector<Job> jobs;
+
+        if (workload == "concurrent")
+        {
+            /* Readers get different files, or different parts of one file */
+            for (int t = 0; t < threads; ++t)
+            {
+                Job job = { entries[t % files], t % files };
+                const int64_t file_size = sizes[job.file];
+                const int readers = files >= threads ? 1 : (threads + files - 1) / files;
+                const int part = t / files;
+
+                if (part < readers)
+                    sequential(job.reads, file_size * part / readers, file_size * (part + 1) / readers, block, 0);
+
+                jobs.push_back(job);
+            }
+        }
+        else
+            for (int i = 0; i < files; ++i)
+            {
+                Job job = { entries[i], i };
+                const int64_t file_size = sizes[job.file];
+
+                if (workload == "sequential")
+                    sequential(job.reads, 0, file_size, block, 0);
+                else if (workload == "strided")
+                    sequential(job.reads, 0, file_size, block, stride);
+                else if (workload == "random")
+                {
+                    uint64_t state = 0x2545F4914F6CDD1DULL + job.file;
+
+                    for (int r = 0; r < reads / files + 1; ++r)
+                    {
+                        /* xorshift64 */
+                        state ^= state << 13;
+                        state ^= state >> 7;
+                        state ^= state << 17;
+
+                        const int64_t offset = (state % std::max<int64_t>(file_size / block, 1)) * block;
+                        Read read = { offset, static_cast<size_t>(std::min(block, file_size - offset)) };
+                        job.reads.push_back(read);
+                    }
+                }
+                else
+                {
+                    ::fprintf(stderr, "Unknown workload \"%s\"\n", workload.c_str());
+                    return 1;
+                }
+
+                jobs.push_back(job);
+            }
+
+        Result result;
+        std::mutex mutex;
+        const uint64_t start = now();
+
+        if (workload == "concurrent")
+        {
+            std::vector<std::thread> workers;
+
+            for (const Job &job : jobs)
+                workers.push_back(std::thread(&run, std::cref(job), std::cref(*content), std::ref(result), std::ref(mutex)));
+
+            for (std::thread &worker : workers)
+                worker.join();
+        }
+        else
+            for (const Job &job : jobs)
+            {
+                /* Only the first file counts for the time to first byte */
+                const double ttfb = result.ttfb;
+                run(job, *content, result, mutex);
+
+                if (ttfb > 0)
+                    result.ttfb = ttfb;
+            }
+
+        const double seconds = (now() - start) / 1000000.0;
+        std::sort(result.latencies.begin(), result.latencies.end());
+
+        ::printf("%s\n  {\"workload\": %s, \"size\": %lld, \"piece_length\": %d, \"files\": %d, \"seeders\": %d, "
+                 "\"block\": %lld, \"memory\": %s, \"bytes\": %llu, \"seconds\": %.3f, \"ttfb_ms\": %.3f, "
+                 "\"mb_per_s\": %.3f, \"reads\": %zu, \"read_p50_ms\": %.3f, \"read_p99_ms\": %.3f, "
+                 "\"deadline_misses\": %llu, \"timeouts\": %llu, \"errors\": %llu}",
+                 w == 0 ? "" : ",",
+                 quote(workload).c_str(),
+                 static_cast<long long>(size),
+                 piece_length,
+                 files,
+                 seeders,
+                 static_cast<long long>(block),
+                 memory ? "true" : "false",
+                 static_cast<unsigned long long>(result.bytes),
+                 seconds,
+                 result.ttfb,
+                 seconds > 0 ? result.bytes / seconds / (1024 * 1024) : 0.0,
+                 result.latencies.size(),
+                 percentile(result.latencies, 0.5),
+                 percentile(result.latencies, 0.99),
+                 static_cast<unsigned long long>(result.deadlineMisses),
+                 static_cast<unsigned long long>(result.timeouts),
+                 static_cast<unsigned long long>(result.errors));
+        ::fflush(stdout);
+    }
+
+    ::printf("\n]\n");
+
+    Session::shutdown();
+
+    for (const std::string &download : downloads)
+        remove(download);
+
+    remove(std::string(root) + "-resume");
+    return 0;
+}
@@ -0,0 +1,363 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bits_bench_Swarm.h"
+#include "lvfs_bits_bench_Common.h"
+#include "lvfs_bits_bench_Link.h"
+#include "lvfs_bits_Hasher.h"
+#include "lvfs_bits_Options.h"
+#include "lvfs_bits_Session.h"
+
+#include <libtorrent/create_torrent.hpp>
+#include <libtorrent/bencode.hpp>
+
+#include <lvfs/IEntry>
+#include <lvfs/IDirectory>
+
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace LVFS {
+namespace BitS {
+namespace Bench {
+
+namespace {
+    enum
+    {
+        WriteBufferSize = 1024 * 1024
+    };
+
+
+    class Hashes : public Hasher::Callback
+    {
+    public:
+        Hashes(libtorrent::create_torrent &torrent) :
+            m_torrent(torrent)
+        {}
+
+        virtual bool piece(int index, const libtorrent::sha1_hash &hash)
+        {
+            /* Every thread has its own pieces */
+            m_torrent.set_hash(index, hash);
+            return true;
+        }
+
+    private:
+        libtorrent::create_torrent &m_torrent;
+    };
+
+
+    static void collect(const IDirectory *dir, std::vector<Interface::Holder> &entries)
+    {
+        for (IDirectory::const_iterator i = dir->begin(), end = dir->end(); i != end; ++i)
+            if (const IDirectory *sub = (*i)->as<IDirectory>())
+                collect(sub, entries);
+            else
+                entries.push_back(*i);
+    }
+
+
+    static inline uint64_t mix(uint64_t value)
+    {
+        /* splitmix64 */
+        value += 0x9E3779B97F4A7C15ULL;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        return value ^ (value >> 31);
+    }
+}
+
+
+Swarm::Content::Content(const std::string &name, const std::vector<int64_t> &files, uint64_t seed) :
+    m_name(name),
+    m_files(files),
+    m_seed(seed)
+{}
+
+Interface::Holder Swarm::Content::open() const
+{
+    return file(m_name + ".torrent", m_torrent);
+}
+
+bool Swarm::Content::check(int file, int64_t offset, const char *data, size_t size) const
+{
+    char buffer[4096];
+
+    for (size_t done = 0, len; done < size; done += len)
+    {
+        len = std::min(size - done, sizeof(buffer));
+        fill(buffer, m_seed, file, offset + done, len);
+
+        if (::memcmp(buffer, data + done, len) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+void Swarm::Content::fill(char *data, uint64_t seed, int file, int64_t offset, size_t size)
+{
+    const uint64_t key = mix(seed ^ (static_cast<uint64_t>(file) << 40));
+
+    for (size_t done = 0; done < size;)
+    {
+        const int64_t pos = offset + done;
+        const uint64_t value = mix(key ^ (pos / sizeof(uint64_t)));
+        const size_t skip = pos % sizeof(uint64_t);
+        const size_t len = std::min(sizeof(uint64_t) - skip, size - done);
+
+        ::memcpy(data + done, reinterpret_cast<const char *>(&value) + skip, len);
+        done += len;
+    }
+}
+
+bool Swarm::Content::entries(const Interface::Holder &torrent, std::vector<Interface::Holder> &entries) const
+{
+    std::vector<Interface::Holder> all;
+    collect(torrent->as<IDirectory>(), all);
+
+    if (all.size() != m_files.size())
+        return false;
+
+    entries.assign(m_files.size(), Interface::Holder());
+
+    /* Files are named by their indexes, a single file by the name of the torrent */
+    for (const Interface::Holder &entry : all)
+    {
+        const char *title = entry->as<IEntry>()->title();
+        const int index = ::strncmp(title, "file-", 5) == 0 ? ::atoi(title + 5) : 0;
+
+        if (index < 0 || index >= entries.size() || entries[index].isValid())
+            return false;
+
+        entries[index] = entry;
+    }
+
+    return true;
+}
+
+bool Swarm::Content::create(const std::string &root, int piece_length)
+{
+    using namespace libtorrent;
+    std::vector<char> buffer(WriteBufferSize);
+    file_storage fs;
+    char name[32];
+
+    if (m_files.size() > 1)
+        ::mkdir((root + "/" + m_name).c_str(), 0700);
+
+    for (int i = 0; i < m_files.size(); ++i)
+    {
+        ::snprintf(name, sizeof(name), "/file-%07d", i);
+
+        const std::string path = m_files.size() == 1 ? m_name : m_name + name;
+        int fd = ::open((root + "/" + path).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+        if (fd == -1)
+            return false;
+
+        for (int64_t offset = 0; offset < m_files[i];)
+        {
+            const size_t len = std::min<int64_t>(buffer.size(), m_files[i] - offset);
+            fill(buffer.data(), m_seed, i, offset, len);
+
+            if (::write(fd, buffer.data(), len) != len)
+            {
+                ::close(fd);
+                return false;
+            }
+
+            offset += len;
+        }
+
+        ::close(fd);
+        fs.add_file(path, m_files[i]);
+    }
+
+    /* No pad files and no reordering, file indexes are the ones the content is made of */
+    create_torrent ct(fs, piece_length, -1, 0);
+    Hashes hashes(ct);
+    Hasher hasher(ct.files(), root);
+
+    if (!hasher.hash(0, ct.num_pieces(), hashes))
+        return false;
+
+    bencode(std::back_inserter(m_torrent), ct.generate());
+
+    error_code ec;
+    m_info.reset(new (std::nothrow) torrent_info(m_torrent.data(), m_torrent.size(), ec));
+
+    return m_info.get() != NULL && !ec;
+}
+
+Swarm::Swarm(const std::string &root, int seeders, int port) :
+    m_root(root),
+    m_count(seeders),
+    m_port(port)
+{}
+
+Swarm::~Swarm()
+{
+    for (Link *link : m_links)
+        delete link;
+
+    for (libtorrent::session *seeder : m_seeders)
+        delete seeder;
+
+    for (Content *content : m_contents)
+        delete content;
+
+    remove(m_root);
+}
+
+bool Swarm::start()
+{
+    using namespace libtorrent;
+
+    if (::mkdir(m_root.c_str(), 0700) != 0)
+        return false;
+
+    for (int i = 0; i < m_count; ++i)
+    {
+        session *seeder = new (std::nothrow) session(fingerprint("LB", 0, 0, 1, 0),
+                                                     std::make_pair(m_port + i, m_port + i),
+                                                     "127.0.0.1",
+                                                     0,
+                                                     alert::error_notification);
+
+        if (seeder == NULL)
+            return false;
+
+        m_seeders.push_back(seeder);
+
+        if (seeder->listen_port() != m_port + i)
+            return false;
+
+        /* The leecher is on the same address */
+        session_settings settings = seeder->settings();
+        settings.allow_multiple_connections_per_ip = true;
+        seeder->set_settings(settings);
+    }
+
+    return true;
+}
+
+bool Swarm::shape(int upload_rate, int round_trip)
+{
+    using namespace libtorrent;
+
+    for (session *seeder : m_seeders)
+    {
+        /* Loopback is a local network, which is not limited by default */
+        session_settings settings = seeder->settings();
+        settings.upload_rate_limit = upload_rate;
+        settings.ignore_limits_on_local_network = false;
+        seeder->set_settings(settings);
+    }
+
+    if (round_trip > 0 && m_links.empty())
+        for (int i = 0; i < m_count; ++i)
+        {
+            Link *link = new (std::nothrow) Link(m_port + i, round_trip);
+
+            if (link == NULL)
+                return false;
+
+            m_links.push_back(link);
+
+            if (!link->start())
+                return false;
+        }
+
+    return true;
+}
+
+const Swarm::Content *Swarm::add(const std::string &name, const std::vector<int64_t> &files, int piece_length, uint64_t seed)
+{
+    using namespace libtorrent;
+    Content *content = new (std::nothrow) Content(name, files, seed);
+
+    if (content == NULL)
+        return NULL;
+
+    m_contents.push_back(content);
+
+    if (!content->create(m_root, piece_length))
+        return NULL;
+
+    for (session *seeder : m_seeders)
+    {
+        add_torrent_params p;
+        error_code ec;
+
+        p.ti = content->info();
+        p.save_path = m_root;
+        p.flags = add_torrent_params::flag_seed_mode;
+
+        seeder->add_torrent(p, ec);
+
+        if (ec)
+            return NULL;
+    }
+
+    return content;
+}
+
+std::string Swarm::peers() const
+{
+    std::string res;
+    char peer[32];
+
+    for (int i = 0; i < m_count; ++i)
+    {
+        ::snprintf(peer, sizeof(peer), "%s127.0.0.1:%d", i == 0 ? "" : ",", m_links.empty() ? m_port + i : m_links[i]->port());
+        res.append(peer);
+    }
+
+    return res;
+}
+
+
+bool configure(const std::string &peers, int port, const std::string &resume_path, bool memory_storage)
+{
+    /* The settings are taken when the session starts */
+    if (Session::current() != NULL)
+        return false;
+
+    Options &options = Options::instance();
+
+    options.listenInterface.setValue("127.0.0.1");
+    options.port.setValue(port);
+    options.offline.setValue(true);
+    options.peers.setValue(peers.c_str());
+    options.resumePath.setValue(resume_path.c_str());
+    options.memoryStorage.setValue(memory_storage);
+
+    return true;
+}
+
+}}}
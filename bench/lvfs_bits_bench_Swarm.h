@@ -0,0 +1,124 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BITS_BENCH_SWARM_H_
+#define LVFS_BITS_BENCH_SWARM_H_
+
+#include <lvfs/Interface>
+#include <libtorrent/session.hpp>
+#include <libtorrent/torrent_info.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+namespace LVFS {
+namespace BitS {
+namespace Bench {
+
+class Link;
+
+
+/**
+ * Seeders of synthetic torrents on loopback.
+ *
+ * Every seeder is a separate libtorrent::session in seed mode listening
+ * on 127.0.0.1, with no DHT, LSD, UPnP or NAT-PMP, so a benchmark runs
+ * on one offline box. All the seeders have all the torrents.
+ *
+ * Links can be shaped: every seeder uploads at most at the given rate,
+ * and with a round trip time set the leecher reaches the seeders through
+ * Link proxies, so peers() gives the addresses of those.
+ *
+ * The content of every file is a function of the seed of its torrent,
+ * the file index and the offset, so readers can check what they got
+ * without keeping a copy of the data.
+ */
+class Swarm
+{
+    PLATFORM_MAKE_NONCOPYABLE(Swarm)
+    PLATFORM_MAKE_NONMOVEABLE(Swarm)
+
+public:
+    class Content
+    {
+        PLATFORM_MAKE_NONCOPYABLE(Content)
+        PLATFORM_MAKE_NONMOVEABLE(Content)
+
+    public:
+        Content(const std::string &name, const std::vector<int64_t> &files, uint64_t seed);
+
+        const std::string &name() const { return m_name; }
+        const std::vector<int64_t> &files() const { return m_files; }
+        const boost::shared_ptr<libtorrent::torrent_info> &info() const { return m_info; }
+
+        /* The .torrent file in memory, opened by TorrentFile */
+        Interface::Holder open() const;
+
+        bool check(int file, int64_t offset, const char *data, size_t size) const;
+        static void fill(char *data, uint64_t seed, int file, int64_t offset, size_t size);
+
+        /* Files of the opened torrent by their indexes */
+        bool entries(const Interface::Holder &torrent, std::vector<Interface::Holder> &entries) const;
+
+    private:
+        friend class Swarm;
+        bool create(const std::string &root, int piece_length);
+
+    private:
+        std::string m_name;
+        std::vector<int64_t> m_files;
+        uint64_t m_seed;
+        std::vector<char> m_torrent;
+        boost::shared_ptr<libtorrent::torrent_info> m_info;
+    };
+
+public:
+    Swarm(const std::string &root, int seeders, int port);
+    ~Swarm();
+
+    bool start();
+
+    /* Upload rate of every seeder in bytes per second (0 is unlimited) and round trip time in ms */
+    bool shape(int upload_rate, int round_trip);
+
+    /* Writes, hashes and seeds a new torrent */
+    const Content *add(const std::string &name, const std::vector<int64_t> &files, int piece_length, uint64_t seed);
+
+    /* Comma separated "address:port" of the seeders, as Options::peers takes them */
+    std::string peers() const;
+
+private:
+    std::string m_root;
+    int m_count;
+    int m_port;
+    std::vector<libtorrent::session *> m_seeders;
+    std::vector<Link *> m_links;
+    std::vector<Content *> m_contents;
+};
+
+
+/* Settings of the leeching session of the plugin, must be called before it starts */
+bool configure(const std::string &peers, int port, const std::string &resume_path, bool memory_storage);
+}}}
+
+#endif /* LVFS_BITS_BENCH_SWARM_H_ */
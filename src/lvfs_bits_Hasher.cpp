@@ -0,0 +1,141 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bits_Hasher.h"
+
+#include <libtorrent/hasher.hpp>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace LVFS {
+namespace BitS {
+
+Hasher::Hasher(const libtorrent::file_storage &files, const std::string &path) :
+    m_files(files),
+    m_path(path),
+    m_error(0)
+{}
+
+Hasher::~Hasher()
+{}
+
+bool Hasher::hash(int first, int last, Callback &callback, int threads)
+{
+    if (threads <= 0)
+        threads = std::thread::hardware_concurrency();
+
+    if (threads <= 0)
+        threads = 1;
+
+    if (threads > last - first)
+        threads = last - first;
+
+    std::vector<std::thread> workers;
+    const int chunk = (last - first + threads - 1) / (threads > 0 ? threads : 1);
+
+    m_error = 0;
+
+    for (int begin = first; begin < last; begin += chunk)
+        workers.push_back(std::thread(&Hasher::run, this, begin, std::min(begin + chunk, last), std::ref(callback)));
+
+    for (std::thread &worker : workers)
+        worker.join();
+
+    if (m_error != 0)
+    {
+        m_lastError = Error(m_error);
+        return false;
+    }
+
+    return true;
+}
+
+void Hasher::run(int first, int last, Callback &callback)
+{
+    std::vector<char> buffer(m_files.piece_length());
+    int current_file = -1;
+    int fd = -1;
+
+    for (int piece = first; piece < last && m_error == 0; ++piece)
+    {
+        const int piece_size = m_files.piece_size(piece);
+        const std::vector<libtorrent::file_slice> slices = m_files.map_block(piece, 0, piece_size);
+        char *buf = buffer.data();
+
+        for (const libtorrent::file_slice &slice : slices)
+        {
+            if (m_files.pad_file_at(slice.file_index))
+            {
+                ::memset(buf, 0, slice.size);
+                buf += slice.size;
+                continue;
+            }
+
+            if (slice.file_index != current_file)
+            {
+                if (fd != -1)
+                    ::close(fd);
+
+                current_file = slice.file_index;
+
+                if ((fd = ::open(m_files.file_path(current_file, m_path).c_str(), O_RDONLY)) == -1)
+                {
+                    m_error = errno;
+                    return;
+                }
+
+                ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            }
+
+            for (libtorrent::size_type offset = slice.offset, left = slice.size; left > 0;)
+            {
+                ssize_t res = ::pread(fd, buf, left, offset);
+
+                if (res > 0)
+                {
+                    buf += res;
+                    offset += res;
+                    left -= res;
+                }
+                else if (res == 0 || errno != EINTR)
+                {
+                    m_error = res == 0 ? EIO : errno;
+                    ::close(fd);
+                    return;
+                }
+            }
+        }
+
+        if (!callback.piece(piece, libtorrent::hasher(buffer.data(), piece_size).final()))
+            m_error = ECANCELED;
+    }
+
+    if (fd != -1)
+        ::close(fd);
+}
+
+}}
@@ -0,0 +1,76 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BITS_HASHER_H_
+#define LVFS_BITS_HASHER_H_
+
+#include <lvfs/Error>
+#include <libtorrent/file_storage.hpp>
+#include <libtorrent/peer_id.hpp>
+
+#include <atomic>
+#include <string>
+
+
+namespace LVFS {
+namespace BitS {
+
+/**
+ * Computes SHA-1 of pieces of local data described by a file_storage.
+ *
+ * The range of pieces is split into contiguous chunks, one per thread,
+ * so every thread reads its files sequentially with large reads.
+ */
+class PLATFORM_MAKE_PRIVATE Hasher
+{
+    PLATFORM_MAKE_NONCOPYABLE(Hasher)
+    PLATFORM_MAKE_NONMOVEABLE(Hasher)
+    PLATFORM_MAKE_STACK_ONLY
+
+public:
+    class Callback
+    {
+    public:
+        virtual ~Callback() {}
+
+        /* Called from the hashing threads */
+        virtual bool piece(int index, const libtorrent::sha1_hash &hash) = 0;
+    };
+
+public:
+    Hasher(const libtorrent::file_storage &files, const std::string &path);
+    ~Hasher();
+
+    bool hash(int first, int last, Callback &callback, int threads = 0);
+
+    const Error &lastError() const { return m_lastError; }
+
+private:
+    void run(int first, int last, Callback &callback);
+
+private:
+    const libtorrent::file_storage &m_files;
+    std::string m_path;
+    Error m_lastError;
+    std::atomic<int> m_error;
+};
+
+}}
+
+#endif /* LVFS_BITS_HASHER_H_ */
@@ -0,0 +1,62 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BITS_IPREFETCH_H_
+#define LVFS_BITS_IPREFETCH_H_
+
+#include <lvfs/Interface>
+
+
+namespace LVFS {
+namespace BitS {
+
+/**
+ * Fetches the first \a head and the last \a tail bytes of every file
+ * below a directory of a torrent in one batch, e.g. to build previews.
+ *
+ * All pieces are scheduled at once with the same deadline. If \a callback
+ * is NULL the call returns right after scheduling, otherwise it blocks
+ * until all pieces are downloaded, the callback returns false or the
+ * download times out. Negative \a head or \a tail fail with EINVAL.
+ *
+ * Opening, seeking or closing streams of the torrent does not cancel the
+ * batch, even where they read the same pieces. A blocking call which
+ * fails or is cancelled gives up the deadlines of the pieces it set.
+ */
+class PLATFORM_MAKE_PUBLIC IPrefetch
+{
+    DECLARE_INTERFACE(LVFS::BitS::IPrefetch)
+
+public:
+    class Callback
+    {
+    public:
+        virtual ~Callback() {}
+        virtual bool progress(int done, int total) = 0;
+    };
+
+public:
+    virtual ~IPrefetch() {}
+
+    virtual bool prefetch(off64_t head, off64_t tail, Callback *callback = NULL) = 0;
+};
+
+}}
+
+#endif /* LVFS_BITS_IPREFETCH_H_ */
@@ -0,0 +1,83 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BITS_ISTATISTICS_H_
+#define LVFS_BITS_ISTATISTICS_H_
+
+#include <lvfs/Interface>
+#include <stdint.h>
+
+
+namespace LVFS {
+namespace BitS {
+
+/**
+ * Performance counters of a stream, of a torrent or of the whole session.
+ *
+ * Times are in milliseconds. Bucket i of readLatency counts piece reads
+ * which took less than 2^i ms, the last one counts everything slower.
+ * Rates, peers and disk cache numbers are reported only while the torrent
+ * (or the session) is running, and are zero for StreamScope: libtorrent
+ * counts them per torrent, not per reader.
+ */
+class PLATFORM_MAKE_PUBLIC IStatistics
+{
+    DECLARE_INTERFACE(LVFS::BitS::IStatistics)
+
+public:
+    enum
+    {
+        LatencyBuckets = 17
+    };
+
+    enum Scope
+    {
+        StreamScope,
+        TorrentScope,
+        SessionScope
+    };
+
+    struct Snapshot
+    {
+        uint64_t bytesRead;
+        uint64_t reads;
+        uint64_t pieceHits;
+        uint64_t pieceMisses;
+        uint64_t downloadWaitTime;
+        uint64_t readWaitTime;
+        uint64_t timeouts;
+        uint64_t deadlineMisses;
+        uint64_t readLatency[LatencyBuckets];
+
+        int downloadRate;
+        int uploadRate;
+        int peers;
+        uint64_t diskBlocksRead;
+        uint64_t diskCacheHits;
+    };
+
+public:
+    virtual ~IStatistics() {}
+
+    virtual bool statistics(Snapshot &snapshot, Scope scope) const = 0;
+};
+
+}}
+
+#endif /* LVFS_BITS_ISTATISTICS_H_ */
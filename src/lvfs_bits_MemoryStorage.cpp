@@ -0,0 +1,306 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bits_MemoryStorage.h"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+
+namespace LVFS {
+namespace BitS {
+
+namespace {
+    static libtorrent::storage_interface *createStorage(const boost::shared_ptr<MemoryStorage::Cache> &cache,
+                                                        const libtorrent::file_storage &files,
+                                                        const libtorrent::file_storage *mapped,
+                                                        const std::string &path,
+                                                        libtorrent::file_pool &pool,
+                                                        const std::vector<boost::uint8_t> &priorities)
+    {
+        return new MemoryStorage(mapped == NULL ? files : *mapped, cache);
+    }
+}
+
+
+MemoryStorage::Cache::Cache(size_t capacity, int piece_length) :
+    m_capacity(capacity),
+    m_pieceLength(piece_length),
+    m_size(0),
+    m_clock(0)
+{}
+
+MemoryStorage::Cache::~Cache()
+{}
+
+bool MemoryStorage::Cache::contains(int piece) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pieces.find(piece) != m_pieces.end();
+}
+
+size_t MemoryStorage::Cache::window() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return windowLocked();
+}
+
+void MemoryStorage::Cache::addCursor(int piece)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cursors.insert(piece);
+}
+
+void MemoryStorage::Cache::moveCursor(int from, int to)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::multiset<int>::iterator i = m_cursors.find(from);
+
+    if (i != m_cursors.end())
+        m_cursors.erase(i);
+
+    m_cursors.insert(to);
+}
+
+void MemoryStorage::Cache::removeCursor(int piece)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::multiset<int>::iterator i = m_cursors.find(piece);
+
+    if (i != m_cursors.end())
+        m_cursors.erase(i);
+}
+
+int MemoryStorage::Cache::read(const libtorrent::file::iovec_t *bufs, int num_bufs, int piece, int offset)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Pieces::iterator i = m_pieces.find(piece);
+
+    if (i == m_pieces.end())
+        return -1;
+
+    const std::vector<char> &data = i->second.data;
+    int res = 0;
+
+    for (int b = 0; b < num_bufs && offset < data.size(); ++b)
+    {
+        const size_t len = std::min(bufs[b].iov_len, data.size() - offset);
+
+        ::memcpy(bufs[b].iov_base, data.data() + offset, len);
+        offset += len;
+        res += len;
+    }
+
+    i->second.used = ++m_clock;
+    return res;
+}
+
+int MemoryStorage::Cache::write(const libtorrent::file::iovec_t *bufs, int num_bufs, int piece, int offset, int piece_size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Piece &p = m_pieces[piece];
+    std::vector<char> &data = p.data;
+    int res = 0;
+
+    if (data.empty())
+    {
+        data.resize(piece_size);
+        m_size += piece_size;
+        p.complete = false;
+    }
+
+    for (int b = 0; b < num_bufs && offset < data.size(); ++b)
+    {
+        const size_t len = std::min(bufs[b].iov_len, data.size() - offset);
+
+        ::memcpy(data.data() + offset, bufs[b].iov_base, len);
+        offset += len;
+        res += len;
+    }
+
+    p.used = ++m_clock;
+    evict();
+
+    return res;
+}
+
+void MemoryStorage::Cache::complete(const libtorrent::bitfield &pieces)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (Pieces::iterator i = m_pieces.begin(); i != m_pieces.end(); ++i)
+        i->second.complete = i->first < pieces.size() && pieces.get_bit(i->first);
+
+    evict();
+}
+
+void MemoryStorage::Cache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_pieces.clear();
+    m_size = 0;
+}
+
+size_t MemoryStorage::Cache::windowLocked() const
+{
+    return m_capacity / std::max<size_t>(m_cursors.size(), 1);
+}
+
+bool MemoryStorage::Cache::isInWindow(int piece) const
+{
+    const int pieces = std::max<int>(windowLocked() / m_pieceLength, 1);
+    std::multiset<int>::const_iterator i = m_cursors.upper_bound(piece);
+
+    /* The closest cursor at or before the piece */
+    return i != m_cursors.begin() && piece < *--i + pieces;
+}
+
+void MemoryStorage::Cache::evict()
+{
+    /*
+     * Least recently used pieces out of the read-ahead windows go first,
+     * then the ones inside them. Pieces libtorrent does not have yet are
+     * still being downloaded or hashed, those are never dropped.
+     */
+    for (int pass = 0; pass < 2 && m_size > m_capacity; ++pass)
+        while (m_size > m_capacity)
+        {
+            Pieces::iterator lru = m_pieces.end();
+
+            for (Pieces::iterator i = m_pieces.begin(); i != m_pieces.end(); ++i)
+                if (i->second.complete && (pass > 0 || !isInWindow(i->first)))
+                    if (lru == m_pieces.end() || i->second.used < lru->second.used)
+                        lru = i;
+
+            if (lru == m_pieces.end())
+                break;
+
+            m_size -= lru->second.data.size();
+            m_pieces.erase(lru);
+        }
+}
+
+MemoryStorage::MemoryStorage(const libtorrent::file_storage &files, const boost::shared_ptr<Cache> &cache) :
+    m_files(files),
+    m_cache(cache)
+{}
+
+MemoryStorage::~MemoryStorage()
+{}
+
+libtorrent::storage_constructor_type MemoryStorage::constructor(const boost::shared_ptr<Cache> &cache)
+{
+    return boost::bind(&createStorage, cache, _1, _2, _3, _4, _5);
+}
+
+bool MemoryStorage::initialize(bool allocate_files)
+{
+    return false;
+}
+
+bool MemoryStorage::has_any_file()
+{
+    return false;
+}
+
+int MemoryStorage::readv(const libtorrent::file::iovec_t *bufs, int slot, int offset, int num_bufs, int flags)
+{
+    int res = m_cache->read(bufs, num_bufs, slot, offset);
+
+    if (res < 0)
+        set_error("", libtorrent::error_code(ENOENT, libtorrent::get_posix_category()));
+
+    return res;
+}
+
+int MemoryStorage::writev(const libtorrent::file::iovec_t *bufs, int slot, int offset, int num_bufs, int flags)
+{
+    return m_cache->write(bufs, num_bufs, slot, offset, m_files.piece_size(slot));
+}
+
+int MemoryStorage::read(char *buf, int slot, int offset, int size)
+{
+    libtorrent::file::iovec_t b = { buf, static_cast<size_t>(size) };
+    return readv(&b, slot, offset, 1, 0);
+}
+
+int MemoryStorage::write(const char *buf, int slot, int offset, int size)
+{
+    libtorrent::file::iovec_t b = { const_cast<char *>(buf), static_cast<size_t>(size) };
+    return writev(&b, slot, offset, 1, 0);
+}
+
+libtorrent::size_type MemoryStorage::physical_offset(int slot, int offset)
+{
+    return static_cast<libtorrent::size_type>(slot) * m_files.piece_length() + offset;
+}
+
+bool MemoryStorage::move_storage(const std::string &save_path, int flags)
+{
+    return false;
+}
+
+bool MemoryStorage::verify_resume_data(const libtorrent::lazy_entry &rd, libtorrent::error_code &error)
+{
+    /* Nothing survives in memory, pieces have to be checked (or downloaded) again */
+    return false;
+}
+
+bool MemoryStorage::write_resume_data(libtorrent::entry &rd) const
+{
+    return false;
+}
+
+/* Slots are moved in compact allocation mode only, which is never used here */
+bool MemoryStorage::move_slot(int src_slot, int dst_slot)
+{
+    return true;
+}
+
+bool MemoryStorage::swap_slots(int slot1, int slot2)
+{
+    return true;
+}
+
+bool MemoryStorage::swap_slots3(int slot1, int slot2, int slot3)
+{
+    return true;
+}
+
+bool MemoryStorage::release_files()
+{
+    return false;
+}
+
+bool MemoryStorage::rename_file(int index, const std::string &new_filename)
+{
+    return false;
+}
+
+bool MemoryStorage::delete_files()
+{
+    m_cache->clear();
+    return false;
+}
+
+}}
@@ -0,0 +1,137 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BITS_MEMORYSTORAGE_H_
+#define LVFS_BITS_MEMORYSTORAGE_H_
+
+#include <lvfs/Interface>
+#include <libtorrent/storage.hpp>
+#include <libtorrent/bitfield.hpp>
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+
+namespace LVFS {
+namespace BitS {
+
+/**
+ * Storage keeping pieces of a torrent in memory only.
+ *
+ * The pieces live in a Cache shared with the streams of the torrent.
+ * Once over its capacity, the cache drops the least recently used of the
+ * pieces libtorrent has, those out of the read-ahead windows of the
+ * streams before the ones inside them. Pieces still being downloaded are
+ * kept, they are bounded by the piece deadlines of the streams. Reading
+ * a dropped piece fails with ENOENT.
+ */
+class PLATFORM_MAKE_PRIVATE MemoryStorage : public libtorrent::storage_interface
+{
+    PLATFORM_MAKE_NONCOPYABLE(MemoryStorage)
+    PLATFORM_MAKE_NONMOVEABLE(MemoryStorage)
+
+public:
+    class Cache
+    {
+        PLATFORM_MAKE_NONCOPYABLE(Cache)
+        PLATFORM_MAKE_NONMOVEABLE(Cache)
+
+    public:
+        Cache(size_t capacity, int piece_length);
+        ~Cache();
+
+        size_t capacity() const { return m_capacity; }
+        bool contains(int piece) const;
+
+        /* Bytes a stream can read ahead, the capacity is split between all of them */
+        size_t window() const;
+
+        void addCursor(int piece);
+        void moveCursor(int from, int to);
+        void removeCursor(int piece);
+
+        int read(const libtorrent::file::iovec_t *bufs, int num_bufs, int piece, int offset);
+        int write(const libtorrent::file::iovec_t *bufs, int num_bufs, int piece, int offset, int piece_size);
+        void clear();
+
+        /* Marks the pieces libtorrent has as safe to drop */
+        void complete(const libtorrent::bitfield &pieces);
+
+    private:
+        struct Piece
+        {
+            std::vector<char> data;
+            uint64_t used;
+            bool complete;
+        };
+
+        typedef std::map<int, Piece> Pieces;
+
+    private:
+        size_t windowLocked() const;
+        bool isInWindow(int piece) const;
+        void evict();
+
+    private:
+        mutable std::mutex m_mutex;
+        size_t m_capacity;
+        int m_pieceLength;
+        size_t m_size;
+        uint64_t m_clock;
+        Pieces m_pieces;
+        std::multiset<int> m_cursors;
+    };
+
+public:
+    MemoryStorage(const libtorrent::file_storage &files, const boost::shared_ptr<Cache> &cache);
+    virtual ~MemoryStorage();
+
+    static libtorrent::storage_constructor_type constructor(const boost::shared_ptr<Cache> &cache);
+
+public: /* libtorrent::storage_interface */
+    virtual bool initialize(bool allocate_files);
+    virtual bool has_any_file();
+
+    virtual int readv(const libtorrent::file::iovec_t *bufs, int slot, int offset, int num_bufs, int flags);
+    virtual int writev(const libtorrent::file::iovec_t *bufs, int slot, int offset, int num_bufs, int flags);
+    virtual int read(char *buf, int slot, int offset, int size);
+    virtual int write(const char *buf, int slot, int offset, int size);
+    virtual libtorrent::size_type physical_offset(int slot, int offset);
+
+    virtual bool move_storage(const std::string &save_path, int flags);
+    virtual bool verify_resume_data(const libtorrent::lazy_entry &rd, libtorrent::error_code &error);
+    virtual bool write_resume_data(libtorrent::entry &rd) const;
+    virtual bool move_slot(int src_slot, int dst_slot);
+    virtual bool swap_slots(int slot1, int slot2);
+    virtual bool swap_slots3(int slot1, int slot2, int slot3);
+    virtual bool release_files();
+    virtual bool rename_file(int index, const std::string &new_filename);
+    virtual bool delete_files();
+
+private:
+    const libtorrent::file_storage &m_files;
+    boost::shared_ptr<Cache> m_cache;
+};
+
+}}
+
+#endif /* LVFS_BITS_MEMORYSTORAGE_H_ */
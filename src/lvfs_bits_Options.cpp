@@ -0,0 +1,62 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bits_Options.h"
+
+
+namespace LVFS {
+namespace BitS {
+
+Options &Options::instance()
+{
+    static Options options;
+    return options;
+}
+
+Options::Options() :
+    Scope("BitS", "BitTorrent"),
+    listenInterface("ListenInterface", "Listen interface", "0.0.0.0"),
+    port("Port", "Listen port", DefaultPort),
+    offline("Offline", "No UPnP, NAT-PMP, local service discovery and DHT", false),
+    peers("Peers", "Peers connected to every torrent", ""),
+    idleTimeout("IdleTimeout", "Seconds an unused torrent stays in the session", DefaultIdleTimeout),
+    activeTorrents("ActiveTorrents", "Torrents kept in the session", DefaultActiveTorrents),
+    resumePath("ResumePath", "Directory of resume data, $XDG_CACHE_HOME/lvfs-bits if empty", ""),
+    localData("LocalData", "Seed the data next to .torrent files", false),
+    memoryStorage("MemoryStorage", "Keep downloaded data in memory", false),
+    memoryLimit("MemoryLimit", "Megabytes of memory per torrent", DefaultMemoryLimit),
+    trace("Trace", "File recording accesses of streams, rewritten by every run", "")
+{
+    manage(&listenInterface);
+    manage(&port);
+    manage(&offline);
+    manage(&peers);
+    manage(&idleTimeout);
+    manage(&activeTorrents);
+    manage(&resumePath);
+    manage(&localData);
+    manage(&memoryStorage);
+    manage(&memoryLimit);
+    manage(&trace);
+}
+
+Options::~Options()
+{}
+
+}}
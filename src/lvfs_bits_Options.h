@@ -0,0 +1,86 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BITS_OPTIONS_H_
+#define LVFS_BITS_OPTIONS_H_
+
+#include <lvfs/settings/Scope>
+#include <lvfs/settings/IntOption>
+#include <lvfs/settings/StringOption>
+#include <lvfs/settings/BooleanOption>
+
+
+namespace LVFS {
+namespace BitS {
+
+/**
+ * Settings of the plugin, exposed by Package::settings().
+ *
+ * Session takes a copy of them when it starts, so changes apply to the
+ * next session.
+ */
+class PLATFORM_MAKE_PRIVATE Options : public ::LVFS::Settings::Scope
+{
+    PLATFORM_MAKE_NONCOPYABLE(Options)
+    PLATFORM_MAKE_NONMOVEABLE(Options)
+
+public:
+    enum
+    {
+        DefaultPort = 50001,
+        DefaultIdleTimeout = 5 * 60,
+        DefaultActiveTorrents = 16,
+        DefaultMemoryLimit = 64
+    };
+
+public:
+    static Options &instance();
+
+public:
+    ::LVFS::Settings::StringOption listenInterface;
+    ::LVFS::Settings::IntOption port;
+    ::LVFS::Settings::BooleanOption offline;
+
+    /* Comma separated list of "address:port" connected to every torrent */
+    ::LVFS::Settings::StringOption peers;
+
+    /* Seconds */
+    ::LVFS::Settings::IntOption idleTimeout;
+    ::LVFS::Settings::IntOption activeTorrents;
+    ::LVFS::Settings::StringOption resumePath;
+
+    /* Seed the data found next to .torrent files instead of downloading it */
+    ::LVFS::Settings::BooleanOption localData;
+
+    ::LVFS::Settings::BooleanOption memoryStorage;
+
+    /* Megabytes */
+    ::LVFS::Settings::IntOption memoryLimit;
+
+    /* File recording accesses of streams, empty if disabled */
+    ::LVFS::Settings::StringOption trace;
+
+private:
+    Options();
+    ~Options();
+};
+
+}}
+
+#endif /* LVFS_BITS_OPTIONS_H_ */
@@ -19,6 +19,8 @@
 
 #include "lvfs_bits_Plugin.h"
 #include "lvfs_bits_Package.h"
+#include "lvfs_bits_Session.h"
+#include "lvfs_bits_Options.h"
 
 #include <lvfs/plugins/Package>
 
@@ -30,7 +32,9 @@ Package::Package()
 {}
 
 Package::~Package()
-{}
+{
+    Session::shutdown();
+}
 
 const char *Package::name() const
 {
@@ -39,7 +43,7 @@ const char *Package::name() const
 
 Settings::Scope *Package::settings() const
 {
-    return NULL;
+    return &Options::instance();
 }
 
 const Package::Plugin **Package::contentPlugins() const
@@ -0,0 +1,812 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bits_Session.h"
+#include "lvfs_bits_Torrent.h"
+#include "lvfs_bits_Options.h"
+
+#include <libtorrent/alert_types.hpp>
+#include <libtorrent/bencode.hpp>
+#include <libtorrent/escape_string.hpp>
+#include <libtorrent/hasher.hpp>
+#include <libtorrent/lazy_entry.hpp>
+#include <libtorrent/socket_io.hpp>
+
+#include <iterator>
+#include <tuple>
+#include <deque>
+#include <cstdlib>
+#include <cstdio>
+
+#include <cerrno>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace LVFS {
+namespace BitS {
+
+namespace {
+    enum
+    {
+        PieceTimeout = 1 * 60 * 1000,
+        ShutdownTimeout = 5 * 1000,
+        SavedPeers = 64,
+        BDecodeDepthLimit = 100,
+        BDecodeItemLimit = 1000000
+    };
+
+    static std::mutex instanceMutex;
+    static Session *sessionInstance = NULL;
+
+
+    /* Comma separated list of "address:port" */
+    static std::vector<libtorrent::tcp::endpoint> parsePeers(const std::string &list)
+    {
+        std::vector<libtorrent::tcp::endpoint> res;
+        libtorrent::error_code ec;
+
+        for (std::string::size_type begin = 0, end; begin < list.size(); begin = end + 1)
+        {
+            if ((end = list.find(',', begin)) == std::string::npos)
+                end = list.size();
+
+            const std::string peer = list.substr(begin, end - begin);
+            const std::string::size_type colon = peer.rfind(':');
+
+            if (colon == std::string::npos)
+                continue;
+
+            const libtorrent::address address = libtorrent::address::from_string(peer.substr(0, colon), ec);
+
+            if (!ec)
+                res.push_back(libtorrent::tcp::endpoint(address, ::atoi(peer.c_str() + colon + 1)));
+        }
+
+        return res;
+    }
+
+    /* $XDG_CACHE_HOME/lvfs-bits, or ~/.cache/lvfs-bits */
+    static std::string defaultResumePath()
+    {
+        const char *cache = ::getenv("XDG_CACHE_HOME");
+
+        if (cache != NULL && *cache == '/')
+            return std::string(cache) + "/lvfs-bits";
+
+        const char *home = ::getenv("HOME");
+
+        if (home == NULL || *home != '/')
+            return std::string();
+
+        const std::string res = std::string(home) + "/.cache";
+        ::mkdir(res.c_str(), 0700);
+
+        return res + "/lvfs-bits";
+    }
+
+    /* Somebody else's directory could feed us resume data or redirect our writes */
+    static bool privateDirectory(const std::string &path)
+    {
+        struct stat st;
+
+        if (::mkdir(path.c_str(), 0700) != 0 && errno != EEXIST)
+            return false;
+
+        return ::lstat(path.c_str(), &st) == 0 &&
+               S_ISDIR(st.st_mode) &&
+               st.st_uid == ::getuid() &&
+               (st.st_mode & 0777) == 0700;
+    }
+
+    static bool readFile(const std::string &name, std::vector<char> &data)
+    {
+        if (name.empty())
+            return false;
+
+        if (std::FILE *file = std::fopen(name.c_str(), "rb"))
+        {
+            char buffer[4096];
+
+            for (size_t res; (res = std::fread(buffer, 1, sizeof(buffer), file)) > 0;)
+                data.insert(data.end(), buffer, buffer + res);
+
+            std::fclose(file);
+            return true;
+        }
+
+        return false;
+    }
+
+    static void writeFile(const std::string &name, const libtorrent::entry &data)
+    {
+        if (name.empty())
+            return;
+
+        std::vector<char> buffer;
+        libtorrent::bencode(std::back_inserter(buffer), data);
+
+        /* Never leave a half written file behind, nor write through a planted link */
+        const std::string temp = name + ".tmp";
+        int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+
+        /* Left by a crash */
+        if (fd == -1 && errno == EEXIST && ::unlink(temp.c_str()) == 0)
+            fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+
+        if (fd == -1)
+            return;
+
+        bool res = true;
+
+        for (size_t done = 0; res && done < buffer.size();)
+        {
+            const ssize_t len = ::write(fd, buffer.data() + done, buffer.size() - done);
+
+            if (len > 0)
+                done += len;
+            else if (len == -1 && errno == EINTR)
+                continue;
+            else
+                res = false;
+        }
+
+        /* The data must be on disk before the rename is */
+        res = res && ::fsync(fd) == 0;
+
+        if (::close(fd) == 0 && res)
+            ::rename(temp.c_str(), name.c_str());
+        else
+            ::unlink(temp.c_str());
+    }
+
+    /* Compact "peers" and "peers6" lists of the resume data */
+    template <int Size, typename Read>
+    static void readPeers(const libtorrent::lazy_entry *list, Read read, std::vector<libtorrent::tcp::endpoint> &peers)
+    {
+        if (list == NULL)
+            return;
+
+        const char *ptr = list->string_ptr();
+
+        for (int i = 0; i + Size <= list->string_length() && peers.size() < static_cast<size_t>(SavedPeers); i += Size)
+            peers.push_back(read(ptr));
+    }
+}
+
+
+Session *Session::instance()
+{
+    std::lock_guard<std::mutex> lock(instanceMutex);
+
+    if (sessionInstance == NULL)
+    {
+        Session *session = new (std::nothrow) Session();
+
+        if (LIKELY(session != NULL))
+            if (session->start())
+                sessionInstance = session;
+            else
+                delete session;
+    }
+
+    return sessionInstance;
+}
+
+Session *Session::current()
+{
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    return sessionInstance;
+}
+
+void Session::shutdown()
+{
+    std::lock_guard<std::mutex> lock(instanceMutex);
+
+    delete sessionInstance;
+    sessionInstance = NULL;
+}
+
+libtorrent::torrent_handle Session::acquire(const libtorrent::sha1_hash &info_hash)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Torrents::iterator i = m_torrents.find(info_hash);
+
+    if (i == m_torrents.end())
+        return libtorrent::torrent_handle();
+
+    if (i->second.evicting)
+    {
+        i->second.evicting = false;
+        i->second.handle.auto_managed(true);
+        i->second.handle.resume();
+    }
+
+    ++i->second.refs;
+    i->second.used = Clock::now();
+
+    return i->second.handle;
+}
+
+libtorrent::torrent_handle Session::acquire(const Torrent &torrent, bool pinned)
+{
+    using namespace libtorrent;
+    const sha1_hash &info_hash = torrent.info()->info_hash();
+
+    /* Looking up and adding is one step, so all users of an info hash get the same torrent */
+    std::lock_guard<std::mutex> adding(m_addMutex);
+    torrent_handle handle = acquire(info_hash);
+
+    if (handle.is_valid())
+    {
+        if (pinned)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Torrents::iterator i = m_torrents.find(info_hash);
+
+            if (i != m_torrents.end())
+                i->second.pinned = true;
+        }
+
+        return handle;
+    }
+
+    add_torrent_params params;
+    boost::shared_ptr<MemoryStorage::Cache> cache;
+
+    if (!torrent.params(*this, params, cache))
+        return torrent_handle();
+
+    /* Adding waits for the network thread, so readers of pieces are not blocked meanwhile */
+    std::vector<char> resume_data;
+    std::vector<tcp::endpoint> peers;
+    error_code ec;
+
+    if (readFile(resumeFile(info_hash), resume_data))
+    {
+        savedPeers(resume_data, peers);
+
+        /* Resume data of a torrent in memory would refer to pieces which are gone */
+        if (params.storage == default_storage_constructor)
+            params.resume_data.swap(resume_data);
+    }
+
+    handle = m_session.add_torrent(params, ec);
+
+    if (ec)
+        return torrent_handle();
+
+    connectPeers(handle, peers);
+
+    /* Pieces dropped from memory are still announced, so peers get next to nothing */
+    if (cache)
+    {
+        handle.set_upload_limit(1);
+        handle.set_max_uploads(1);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const bool seed = (params.flags & add_torrent_params::flag_seed_mode) != 0;
+    Record record = { handle, 1, pinned, false, Clock::now(), seed, std::vector<bool>(seed ? params.ti->num_pieces() : 0, false), cache, Deadlines() };
+    m_torrents.insert(Torrents::value_type(info_hash, record));
+    evictLeastRecentlyUsed();
+
+    return handle;
+}
+
+void Session::release(const libtorrent::torrent_handle &handle)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Torrents::iterator i = m_torrents.find(handle.info_hash());
+
+    if (i != m_torrents.end() && i->second.refs > 0)
+    {
+        --i->second.refs;
+        i->second.used = Clock::now();
+    }
+}
+
+bool Session::readPiece(const libtorrent::torrent_handle &handle, int piece, boost::shared_array<char> &data, int &size, uint32_t &time_left)
+{
+    const Pieces::key_type key(handle.info_hash(), piece);
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(time_left);
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    handle.read_piece(piece);
+
+    for (;;)
+    {
+        Pieces::iterator i = m_pieces.find(key);
+
+        if (i != m_pieces.end())
+        {
+            const bool res = !i->second.failed;
+
+            data = i->second.data;
+            size = i->second.size;
+            m_pieces.erase(i);
+
+            const Clock::time_point now = Clock::now();
+            time_left = now < deadline ? std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() : 0;
+
+            return res;
+        }
+
+        if (m_condition.wait_until(lock, deadline) == std::cv_status::timeout && m_pieces.find(key) == m_pieces.end())
+        {
+            time_left = 0;
+            return false;
+        }
+    }
+}
+
+void Session::setDeadline(const libtorrent::torrent_handle &handle, int piece, int deadline, bool acquire)
+{
+    const Clock::time_point now = Clock::now();
+    Clock::time_point due = now + std::chrono::milliseconds(deadline);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Torrents::iterator i = m_torrents.find(handle.info_hash());
+
+    if (i == m_torrents.end())
+        return;
+
+    Deadline &current = i->second.deadlines[piece];
+
+    if (acquire)
+        ++current.refs;
+
+    if (current.due > now && current.due < due)
+        due = current.due;
+    else
+        current.due = due;
+
+    /* Under the lock, so a reset by the last user can not overtake it */
+    handle.set_piece_deadline(piece, std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count());
+}
+
+void Session::resetDeadline(const libtorrent::torrent_handle &handle, int piece)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Torrents::iterator i = m_torrents.find(handle.info_hash());
+
+    if (i == m_torrents.end())
+        return;
+
+    Deadlines::iterator deadline = i->second.deadlines.find(piece);
+
+    if (deadline != i->second.deadlines.end() && --deadline->second.refs <= 0)
+    {
+        i->second.deadlines.erase(deadline);
+        handle.reset_piece_deadline(piece);
+    }
+}
+
+boost::shared_ptr<MemoryStorage::Cache> Session::cache(const libtorrent::torrent_handle &handle)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Torrents::const_iterator i = m_torrents.find(handle.info_hash());
+
+    if (i == m_torrents.end())
+        return boost::shared_ptr<MemoryStorage::Cache>();
+
+    return i->second.cache;
+}
+
+bool Session::verify(const libtorrent::torrent_handle &handle, const libtorrent::torrent_info &info, int piece, const char *data, int size)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Torrents::const_iterator i = m_torrents.find(info.info_hash());
+
+        if (i == m_torrents.end() || !i->second.seed || i->second.verified[piece])
+            return true;
+    }
+
+    const bool valid = libtorrent::hasher(data, size).final() == info.hash_for_piece(piece);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Torrents::iterator i = m_torrents.find(info.info_hash());
+
+    if (i == m_torrents.end() || !i->second.seed)
+        return valid;
+
+    if (valid)
+    {
+        i->second.verified[piece] = true;
+        return true;
+    }
+
+    /* The local data is damaged, now it is up to libtorrent to find out what to download */
+    i->second.seed = false;
+    i->second.verified.clear();
+    handle.force_recheck();
+
+    return false;
+}
+
+Statistics &Session::statistics(const libtorrent::sha1_hash &info_hash)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    TorrentStatistics::iterator i = m_statistics.find(info_hash);
+
+    if (i == m_statistics.end())
+        i = m_statistics.emplace(std::piecewise_construct, std::forward_as_tuple(info_hash), std::forward_as_tuple(&Statistics::session())).first;
+
+    return i->second;
+}
+
+void Session::status(IStatistics::Snapshot &snapshot) const
+{
+    const libtorrent::session_status status = m_session.status();
+    const libtorrent::cache_status cache = m_session.get_cache_status();
+
+    snapshot.downloadRate = status.download_rate;
+    snapshot.uploadRate = status.upload_rate;
+    snapshot.peers = status.num_peers;
+    snapshot.diskBlocksRead = cache.blocks_read;
+    snapshot.diskCacheHits = cache.blocks_read_hit;
+}
+
+bool Session::status(const libtorrent::sha1_hash &info_hash, IStatistics::Snapshot &snapshot)
+{
+    libtorrent::torrent_handle handle;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Torrents::const_iterator i = m_torrents.find(info_hash);
+
+        if (i == m_torrents.end())
+            return false;
+
+        handle = i->second.handle;
+    }
+
+    status(handle, snapshot);
+    return true;
+}
+
+void Session::status(const libtorrent::torrent_handle &handle, IStatistics::Snapshot &snapshot)
+{
+    const libtorrent::torrent_status status = handle.status(0);
+
+    snapshot.downloadRate = status.download_rate;
+    snapshot.uploadRate = status.upload_rate;
+    snapshot.peers = status.num_peers;
+}
+
+Session::Session() :
+    m_stop(false)
+{
+    const Options &options = Options::instance();
+
+    m_settings.listenInterface = options.listenInterface.value();
+    m_settings.port = options.port.value();
+    m_settings.offline = options.offline.value();
+    m_settings.peers = parsePeers(options.peers.value());
+    m_settings.idleTimeout = options.idleTimeout.value();
+    m_settings.activeTorrents = options.activeTorrents.value();
+    const char *resume_path = options.resumePath.value();
+    m_settings.resumePath = resume_path == NULL || *resume_path == 0 ? defaultResumePath() : resume_path;
+    m_settings.memoryStorage = options.memoryStorage.value();
+    m_settings.memoryLimit = static_cast<size_t>(options.memoryLimit.value()) * 1024 * 1024;
+
+    m_session.set_alert_mask(libtorrent::alert::error_notification |
+                             libtorrent::alert::storage_notification |
+                             libtorrent::alert::status_notification);
+}
+
+Session::~Session()
+{
+    m_stop = true;
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+        saveState();
+    }
+}
+
+bool Session::start()
+{
+    libtorrent::error_code ec;
+
+    m_session.listen_on(std::make_pair(m_settings.port, m_settings.port), ec, m_settings.listenInterface.c_str());
+
+    if (ec)
+        return false;
+
+    if (m_settings.offline)
+    {
+        m_session.stop_lsd();
+        m_session.stop_upnp();
+        m_session.stop_natpmp();
+    }
+
+    /* Nothing is saved or loaded without a directory of our own */
+    if (m_settings.resumePath.empty() || !privateDirectory(m_settings.resumePath))
+        m_settings.resumePath.clear();
+
+    loadState();
+
+    if (!m_settings.peers.empty())
+    {
+        /* All the local peers have the same address */
+        libtorrent::session_settings settings = m_session.settings();
+        settings.allow_multiple_connections_per_ip = true;
+        m_session.set_settings(settings);
+    }
+
+    if (!m_settings.offline)
+    {
+        /* Uses the routing table restored by loadState() */
+        m_session.add_dht_router(std::make_pair(std::string("router.bittorrent.com"), 6881));
+        m_session.add_dht_router(std::make_pair(std::string("router.utorrent.com"), 6881));
+        m_session.start_dht();
+    }
+
+    m_thread = std::thread(&Session::run, this);
+
+    return true;
+}
+
+void Session::run()
+{
+    typedef std::pair<libtorrent::torrent_handle, boost::shared_ptr<MemoryStorage::Cache> > Cached;
+    Clock::time_point polled;
+
+    while (!m_stop)
+    {
+        if (m_session.wait_for_alert(libtorrent::milliseconds(PokeTimeout)))
+            handleAlerts();
+
+        if (Clock::now() - polled >= std::chrono::milliseconds(PokeTimeout))
+        {
+            std::vector<Cached> cached;
+            polled = Clock::now();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                for (Torrents::const_iterator i = m_torrents.begin(); i != m_torrents.end(); ++i)
+                    if (i->second.cache)
+                        cached.push_back(Cached(i->second.handle, i->second.cache));
+            }
+
+            /* Only the pieces libtorrent has verified may be dropped from memory */
+            for (const Cached &torrent : cached)
+                torrent.second->complete(torrent.first.status(libtorrent::torrent_handle::query_pieces).pieces);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const Clock::time_point stale = Clock::now() - std::chrono::milliseconds(PieceTimeout);
+
+        /* Pieces whose readers have given up waiting */
+        for (Pieces::iterator i = m_pieces.begin(); i != m_pieces.end();)
+            if (i->second.ready < stale)
+                i = m_pieces.erase(i);
+            else
+                ++i;
+
+        evictIdle();
+    }
+}
+
+int Session::handleAlerts()
+{
+    using namespace libtorrent;
+    typedef std::pair<sha1_hash, boost::shared_ptr<entry> > ResumeData;
+
+    std::deque<alert *> alerts;
+    std::vector<ResumeData> resume_data;
+
+    m_session.pop_alerts(&alerts);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (alert *a : alerts)
+        {
+            if (const read_piece_alert *read_alert = alert_cast<read_piece_alert>(a))
+            {
+                Piece piece = { read_alert->buffer, read_alert->size, read_alert->ec ? true : false, Clock::now() };
+                m_pieces.insert(Pieces::value_type(Pieces::key_type(read_alert->handle.info_hash(), read_alert->piece), piece));
+            }
+            else if (const save_resume_data_alert *resume_alert = alert_cast<save_resume_data_alert>(a))
+                resume_data.push_back(ResumeData(resume_alert->handle.info_hash(), resume_alert->resume_data));
+            else if (const save_resume_data_failed_alert *failed_alert = alert_cast<save_resume_data_failed_alert>(a))
+                resume_data.push_back(ResumeData(failed_alert->handle.info_hash(), boost::shared_ptr<entry>()));
+            else if (const file_error_alert *error_alert = alert_cast<file_error_alert>(a))
+            {
+                Torrents::const_iterator i = m_torrents.find(error_alert->handle.info_hash());
+
+                /*
+                 * A piece dropped from memory has been read, libtorrent pauses the
+                 * torrent on it. Nothing else is wrong with the torrent, streams
+                 * wanting the piece get it downloaded again by themselves.
+                 */
+                if (i != m_torrents.end() && i->second.cache && error_alert->error == boost::system::errc::no_such_file_or_directory)
+                {
+                    i->second.handle.clear_error();
+                    i->second.handle.resume();
+                }
+            }
+
+            delete a;
+        }
+
+        m_condition.notify_all();
+    }
+
+    if (resume_data.empty())
+        return 0;
+
+    /*
+     * Files are written without holding m_mutex, which readers of pieces
+     * wait for, but before evicted torrents are removed, so adding one
+     * again always finds its latest resume data.
+     */
+    std::lock_guard<std::mutex> adding(m_addMutex);
+
+    for (const ResumeData &data : resume_data)
+        if (data.second)
+            writeFile(resumeFile(data.first), *data.second);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (const ResumeData &data : resume_data)
+    {
+        Torrents::iterator i = m_torrents.find(data.first);
+
+        /* Acquiring a torrent cancels its eviction */
+        if (i != m_torrents.end() && i->second.evicting)
+        {
+            m_session.remove_torrent(i->second.handle);
+            m_torrents.erase(i);
+        }
+    }
+
+    return resume_data.size();
+}
+
+void Session::evictIdle()
+{
+    const Clock::time_point idle = Clock::now() - std::chrono::seconds(m_settings.idleTimeout);
+
+    for (Torrents::iterator i = m_torrents.begin(); i != m_torrents.end(); ++i)
+        if (i->second.refs == 0 && !i->second.pinned && !i->second.evicting && i->second.used <= idle)
+            evict(i->second);
+}
+
+void Session::evictLeastRecentlyUsed()
+{
+    int active = 0;
+
+    for (Torrents::iterator i = m_torrents.begin(); i != m_torrents.end(); ++i)
+        if (!i->second.evicting)
+            ++active;
+
+    for (; active > m_settings.activeTorrents; --active)
+    {
+        Torrents::iterator lru = m_torrents.end();
+
+        for (Torrents::iterator i = m_torrents.begin(); i != m_torrents.end(); ++i)
+            if (i->second.refs == 0 && !i->second.pinned && !i->second.evicting)
+                if (lru == m_torrents.end() || i->second.used < lru->second.used)
+                    lru = i;
+
+        if (lru == m_torrents.end())
+            break;
+
+        evict(lru->second);
+    }
+}
+
+void Session::evict(Record &record)
+{
+    record.evicting = true;
+    record.handle.auto_managed(false);
+    record.handle.pause();
+    record.handle.save_resume_data();
+}
+
+void Session::connectPeers(const libtorrent::torrent_handle &handle, const std::vector<libtorrent::tcp::endpoint> &peers) const
+{
+    for (const libtorrent::tcp::endpoint &peer : m_settings.peers)
+        handle.connect_peer(peer);
+
+    for (const libtorrent::tcp::endpoint &peer : peers)
+        handle.connect_peer(peer);
+}
+
+std::string Session::resumeFile(const libtorrent::sha1_hash &info_hash) const
+{
+    if (m_settings.resumePath.empty())
+        return std::string();
+
+    return m_settings.resumePath + "/" + libtorrent::to_hex(info_hash.to_string()) + ".resume";
+}
+
+void Session::savedPeers(const std::vector<char> &resume_data, std::vector<libtorrent::tcp::endpoint> &peers) const
+{
+    using namespace libtorrent;
+    lazy_entry entry;
+    error_code ec;
+
+    if (resume_data.empty() ||
+        lazy_bdecode(resume_data.data(), resume_data.data() + resume_data.size(), entry, ec, NULL, BDecodeDepthLimit, BDecodeItemLimit) != 0 ||
+        entry.type() != lazy_entry::dict_t)
+    {
+        return;
+    }
+
+    readPeers<6>(entry.dict_find_string("peers"), &detail::read_v4_endpoint<tcp::endpoint, const char *>, peers);
+#if TORRENT_USE_IPV6
+    readPeers<18>(entry.dict_find_string("peers6"), &detail::read_v6_endpoint<tcp::endpoint, const char *>, peers);
+#endif
+}
+
+void Session::loadState()
+{
+    using namespace libtorrent;
+    std::vector<char> state;
+    lazy_entry entry;
+    error_code ec;
+
+    if (readFile(stateFile(), state) &&
+        lazy_bdecode(state.data(), state.data() + state.size(), entry, ec, NULL, BDecodeDepthLimit, BDecodeItemLimit) == 0)
+    {
+        m_session.load_state(entry);
+    }
+}
+
+void Session::saveState()
+{
+    using namespace libtorrent;
+    int pending = 0;
+
+    /* Peer lists and pieces of all the torrents, evicted ones are already being saved */
+    m_session.pause();
+
+    for (Torrents::iterator i = m_torrents.begin(); i != m_torrents.end(); ++i, ++pending)
+        if (!i->second.evicting)
+            i->second.handle.save_resume_data();
+
+    for (const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(ShutdownTimeout);
+         pending > 0 && Clock::now() < deadline;)
+    {
+        if (m_session.wait_for_alert(milliseconds(PokeTimeout)))
+            pending -= handleAlerts();
+    }
+
+    /* Only the DHT routing table, settings come from Options on every start */
+    entry state;
+    m_session.save_state(state, session::save_dht_state);
+    writeFile(stateFile(), state);
+}
+
+std::string Session::stateFile() const
+{
+    if (m_settings.resumePath.empty())
+        return std::string();
+
+    return m_settings.resumePath + "/session.state";
+}
+
+}}
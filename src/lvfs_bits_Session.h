@@ -0,0 +1,213 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BITS_SESSION_H_
+#define LVFS_BITS_SESSION_H_
+
+#include <lvfs/Interface>
+#include <libtorrent/session.hpp>
+#include <libtorrent/add_torrent_params.hpp>
+#include <libtorrent/socket.hpp>
+
+#include "lvfs_bits_Statistics.h"
+#include "lvfs_bits_MemoryStorage.h"
+#include <boost/shared_array.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace LVFS {
+namespace BitS {
+
+class Torrent;
+
+
+/**
+ * The libtorrent session shared by all opened .torrent files.
+ *
+ * It is created on the first Session::instance() call, which happens
+ * when some file of a torrent is opened, so listing .torrent files does
+ * not start networking, disk threads or bind the listen port.
+ *
+ * Torrents are reference counted by their users (streams, prefetches).
+ * A torrent nobody uses for Settings::idleTimeout seconds, or the least
+ * recently used idle one when there are more than
+ * Settings::activeTorrents of them, is paused, its resume data is saved
+ * and it is removed from the session.
+ *
+ * All alerts are handled by one thread, which hands out the results of
+ * read_piece() to the waiting streams.
+ *
+ * For a swarm on one box (e.g. seeders on loopback) Settings::peers are
+ * connected to every added torrent, and Settings::offline turns off
+ * UPnP, NAT-PMP, local service discovery and DHT.
+ *
+ * The DHT routing table is saved to Settings::resumePath on shutdown
+ * and restored on start. Resume data, saved on eviction and on
+ * shutdown, keeps the pieces and the peers of a torrent, and those
+ * peers are connected as soon as it is added again. Nothing is saved
+ * or loaded unless that directory is ours and private (mode 0700).
+ *
+ * Counters of a torrent are kept by info hash for the life of the
+ * session, so they survive eviction and are shared by every opened
+ * .torrent file of it.
+ */
+class PLATFORM_MAKE_PRIVATE Session
+{
+    PLATFORM_MAKE_NONCOPYABLE(Session)
+    PLATFORM_MAKE_NONMOVEABLE(Session)
+
+public:
+    enum
+    {
+        PokeTimeout = 100
+    };
+
+    /* A copy of Options taken when the session starts */
+    struct Settings
+    {
+        std::string listenInterface;
+        int port;
+        bool offline;
+        std::vector<libtorrent::tcp::endpoint> peers;
+        int idleTimeout;
+        int activeTorrents;
+        std::string resumePath;
+        bool memoryStorage;
+        size_t memoryLimit;
+    };
+
+public:
+    static Session *instance();
+    static Session *current();
+    static void shutdown();
+
+    const Settings &settings() const { return m_settings; }
+
+    libtorrent::torrent_handle acquire(const libtorrent::sha1_hash &info_hash);
+    libtorrent::torrent_handle acquire(const Torrent &torrent, bool pinned = false);
+    void release(const libtorrent::torrent_handle &handle);
+
+    boost::shared_ptr<MemoryStorage::Cache> cache(const libtorrent::torrent_handle &handle);
+
+    /*
+     * Deadlines of pieces are shared by the streams and prefetches of a
+     * torrent. Every user takes a reference (acquire) once and may then
+     * move the deadline, the earliest one wins. A deadline is reset only
+     * when its last user releases it.
+     */
+    void setDeadline(const libtorrent::torrent_handle &handle, int piece, int deadline, bool acquire);
+    void resetDeadline(const libtorrent::torrent_handle &handle, int piece);
+
+    bool verify(const libtorrent::torrent_handle &handle, const libtorrent::torrent_info &info, int piece, const char *data, int size);
+
+    bool readPiece(const libtorrent::torrent_handle &handle, int piece, boost::shared_array<char> &data, int &size, uint32_t &time_left);
+
+    Statistics &statistics(const libtorrent::sha1_hash &info_hash);
+
+    void status(IStatistics::Snapshot &snapshot) const;
+    bool status(const libtorrent::sha1_hash &info_hash, IStatistics::Snapshot &snapshot);
+    static void status(const libtorrent::torrent_handle &handle, IStatistics::Snapshot &snapshot);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Deadline
+    {
+        int refs;
+        Clock::time_point due;
+    };
+
+    typedef std::map<int, Deadline> Deadlines;
+
+    struct Record
+    {
+        libtorrent::torrent_handle handle;
+        int refs;
+        bool pinned;
+        bool evicting;
+        Clock::time_point used;
+
+        /* Pieces of a torrent in seed mode are verified on first read */
+        bool seed;
+        std::vector<bool> verified;
+
+        /* Pieces of a torrent in memory, shared by all its streams */
+        boost::shared_ptr<MemoryStorage::Cache> cache;
+
+        Deadlines deadlines;
+    };
+
+    struct Piece
+    {
+        boost::shared_array<char> data;
+        int size;
+        bool failed;
+        Clock::time_point ready;
+    };
+
+    typedef std::map<libtorrent::sha1_hash, Record> Torrents;
+    typedef std::map<libtorrent::sha1_hash, Statistics> TorrentStatistics;
+    typedef std::multimap<std::pair<libtorrent::sha1_hash, int>, Piece> Pieces;
+
+private:
+    Session();
+    ~Session();
+
+    bool start();
+    void run();
+    int handleAlerts();
+    void evictIdle();
+    void evictLeastRecentlyUsed();
+    void evict(Record &record);
+
+    void connectPeers(const libtorrent::torrent_handle &handle, const std::vector<libtorrent::tcp::endpoint> &peers) const;
+
+    std::string resumeFile(const libtorrent::sha1_hash &info_hash) const;
+    void savedPeers(const std::vector<char> &resume_data, std::vector<libtorrent::tcp::endpoint> &peers) const;
+
+    void loadState();
+    void saveState();
+    std::string stateFile() const;
+
+private:
+    Settings m_settings;
+    libtorrent::session m_session;
+
+    std::mutex m_addMutex;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    Torrents m_torrents;
+    Pieces m_pieces;
+    TorrentStatistics m_statistics;
+
+    std::atomic<bool> m_stop;
+    std::thread m_thread;
+};
+
+}}
+
+#endif /* LVFS_BITS_SESSION_H_ */
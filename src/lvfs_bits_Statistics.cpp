@@ -0,0 +1,105 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bits_Statistics.h"
+
+#include <cstring>
+
+
+namespace LVFS {
+namespace BitS {
+
+Statistics::Statistics(Statistics *parent) :
+    m_parent(parent),
+    m_bytesRead(0),
+    m_reads(0),
+    m_pieceHits(0),
+    m_pieceMisses(0),
+    m_downloadWaitTime(0),
+    m_readWaitTime(0),
+    m_timeouts(0),
+    m_deadlineMisses(0)
+{
+    for (int i = 0; i < IStatistics::LatencyBuckets; ++i)
+        m_readLatency[i] = 0;
+}
+
+Statistics::~Statistics()
+{}
+
+Statistics &Statistics::session()
+{
+    static Statistics statistics;
+    return statistics;
+}
+
+void Statistics::read(size_t bytes)
+{
+    m_bytesRead.fetch_add(bytes, std::memory_order_relaxed);
+    m_reads.fetch_add(1, std::memory_order_relaxed);
+
+    if (m_parent)
+        m_parent->read(bytes);
+}
+
+void Statistics::piece(bool ready, uint32_t download_wait, uint32_t read_wait, bool deadline_missed)
+{
+    int bucket = 0;
+
+    for (uint32_t latency = download_wait + read_wait; latency > 0 && bucket < IStatistics::LatencyBuckets - 1; latency >>= 1)
+        ++bucket;
+
+    (ready ? m_pieceHits : m_pieceMisses).fetch_add(1, std::memory_order_relaxed);
+    m_downloadWaitTime.fetch_add(download_wait, std::memory_order_relaxed);
+    m_readWaitTime.fetch_add(read_wait, std::memory_order_relaxed);
+    m_readLatency[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    if (deadline_missed)
+        m_deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+
+    if (m_parent)
+        m_parent->piece(ready, download_wait, read_wait, deadline_missed);
+}
+
+void Statistics::timeout()
+{
+    m_timeouts.fetch_add(1, std::memory_order_relaxed);
+
+    if (m_parent)
+        m_parent->timeout();
+}
+
+void Statistics::snapshot(IStatistics::Snapshot &snapshot) const
+{
+    ::memset(&snapshot, 0, sizeof(snapshot));
+
+    snapshot.bytesRead = m_bytesRead.load(std::memory_order_relaxed);
+    snapshot.reads = m_reads.load(std::memory_order_relaxed);
+    snapshot.pieceHits = m_pieceHits.load(std::memory_order_relaxed);
+    snapshot.pieceMisses = m_pieceMisses.load(std::memory_order_relaxed);
+    snapshot.downloadWaitTime = m_downloadWaitTime.load(std::memory_order_relaxed);
+    snapshot.readWaitTime = m_readWaitTime.load(std::memory_order_relaxed);
+    snapshot.timeouts = m_timeouts.load(std::memory_order_relaxed);
+    snapshot.deadlineMisses = m_deadlineMisses.load(std::memory_order_relaxed);
+
+    for (int i = 0; i < IStatistics::LatencyBuckets; ++i)
+        snapshot.readLatency[i] = m_readLatency[i].load(std::memory_order_relaxed);
+}
+
+}}
@@ -0,0 +1,69 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BITS_STATISTICS_H_
+#define LVFS_BITS_STATISTICS_H_
+
+#include "lvfs_bits_IStatistics.h"
+
+#include <atomic>
+
+
+namespace LVFS {
+namespace BitS {
+
+/**
+ * Lock-free counters behind IStatistics.
+ *
+ * Every update is also applied to the parent, so counters of a stream
+ * roll up into its torrent and further into the session.
+ */
+class PLATFORM_MAKE_PRIVATE Statistics
+{
+    PLATFORM_MAKE_NONCOPYABLE(Statistics)
+    PLATFORM_MAKE_NONMOVEABLE(Statistics)
+
+public:
+    Statistics(Statistics *parent = NULL);
+    ~Statistics();
+
+    static Statistics &session();
+
+    void read(size_t bytes);
+    void piece(bool ready, uint32_t download_wait, uint32_t read_wait, bool deadline_missed);
+    void timeout();
+
+    void snapshot(IStatistics::Snapshot &snapshot) const;
+
+private:
+    Statistics *m_parent;
+    std::atomic<uint64_t> m_bytesRead;
+    std::atomic<uint64_t> m_reads;
+    std::atomic<uint64_t> m_pieceHits;
+    std::atomic<uint64_t> m_pieceMisses;
+    std::atomic<uint64_t> m_downloadWaitTime;
+    std::atomic<uint64_t> m_readWaitTime;
+    std::atomic<uint64_t> m_timeouts;
+    std::atomic<uint64_t> m_deadlineMisses;
+    std::atomic<uint64_t> m_readLatency[IStatistics::LatencyBuckets];
+};
+
+}}
+
+#endif /* LVFS_BITS_STATISTICS_H_ */
@@ -0,0 +1,96 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bits_Torrent.h"
+#include "lvfs_bits_Session.h"
+
+#include <sys/stat.h>
+
+
+namespace LVFS {
+namespace BitS {
+
+static const char DefaultSavePath[] = "/tmp";
+
+
+Torrent::Torrent(const boost::shared_ptr<libtorrent::torrent_info> &info, const std::string &local_path) :
+    m_info(info),
+    m_localPath(local_path),
+    m_hasData(false)
+{}
+
+Torrent::~Torrent()
+{}
+
+libtorrent::torrent_handle Torrent::acquire(Session &session, bool pinned)
+{
+    if (!m_localPath.empty())
+        std::call_once(m_checked, [this]() { m_hasData = hasData(*m_info, m_localPath); });
+
+    return session.acquire(*this, pinned);
+}
+
+bool Torrent::params(Session &session, libtorrent::add_torrent_params &p, boost::shared_ptr<MemoryStorage::Cache> &cache) const
+{
+    using namespace libtorrent;
+
+    p.ti = m_info;
+
+    /*
+     * Sizes of files in the default save path tell nothing, sparse files
+     * are full-sized as soon as their last pieces are written (e.g. by a
+     * prefetch), so only data at a location given by the creator is trusted.
+     */
+    if (m_hasData)
+    {
+        p.save_path = m_localPath;
+        p.flags |= add_torrent_params::flag_seed_mode;
+    }
+    else if (session.settings().memoryStorage)
+    {
+        /* Only pieces with deadlines are downloaded, otherwise the whole torrent ends up in memory */
+        p.save_path = DefaultSavePath;
+        p.file_priorities.assign(m_info->num_files(), 0);
+        cache.reset(new (std::nothrow) MemoryStorage::Cache(session.settings().memoryLimit, m_info->piece_length()));
+
+        if (UNLIKELY(cache.get() == NULL))
+            return false;
+
+        p.storage = MemoryStorage::constructor(cache);
+    }
+    else
+        p.save_path = DefaultSavePath;
+
+    return true;
+}
+
+bool Torrent::hasData(const libtorrent::torrent_info &info, const std::string &path)
+{
+    struct stat st;
+    const libtorrent::file_storage &files = info.files();
+
+    for (int i = 0; i < files.num_files(); ++i)
+        if (!files.pad_file_at(i))
+            if (::stat(files.file_path(i, path).c_str(), &st) != 0 || st.st_size != files.file_size(i))
+                return false;
+
+    return true;
+}
+
+}}
@@ -0,0 +1,85 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BITS_TORRENT_H_
+#define LVFS_BITS_TORRENT_H_
+
+#include <lvfs/Interface>
+#include <libtorrent/torrent_info.hpp>
+#include <libtorrent/torrent_handle.hpp>
+#include <libtorrent/add_torrent_params.hpp>
+
+#include "lvfs_bits_MemoryStorage.h"
+
+#include <mutex>
+#include <string>
+
+
+namespace LVFS {
+namespace BitS {
+
+class Session;
+
+
+/**
+ * Metadata of a torrent and the location of its data.
+ *
+ * Local data is used only when the creator gives its location: the
+ * directory of the .torrent file if Options::localData is set, or the
+ * data just hashed by TorrentFile::copy(). If all files are there with
+ * their sizes the torrent is attached in seed mode, without a full
+ * recheck, and Session verifies its pieces lazily on first read. The
+ * files are checked once, before Session is asked for the torrent, so
+ * big torrents do not hold up other users of the session. Otherwise the
+ * data is downloaded into
+ * the default save path, where the saved resume data tells which pieces
+ * are already there, or into memory if Session::Settings::memoryStorage
+ * is set.
+ *
+ * Every opened .torrent file has its own Torrent, everything shared by
+ * the users of one info hash is kept by Session.
+ */
+class PLATFORM_MAKE_PRIVATE Torrent
+{
+    PLATFORM_MAKE_NONCOPYABLE(Torrent)
+    PLATFORM_MAKE_NONMOVEABLE(Torrent)
+
+public:
+    Torrent(const boost::shared_ptr<libtorrent::torrent_info> &info, const std::string &local_path);
+    ~Torrent();
+
+    const boost::shared_ptr<libtorrent::torrent_info> &info() const { return m_info; }
+
+    libtorrent::torrent_handle acquire(Session &session, bool pinned = false);
+
+    /* Called by Session when the torrent is not in it yet */
+    bool params(Session &session, libtorrent::add_torrent_params &params, boost::shared_ptr<MemoryStorage::Cache> &cache) const;
+
+    static bool hasData(const libtorrent::torrent_info &info, const std::string &path);
+
+private:
+    boost::shared_ptr<libtorrent::torrent_info> m_info;
+    std::string m_localPath;
+    std::once_flag m_checked;
+    bool m_hasData;
+};
+
+}}
+
+#endif /* LVFS_BITS_TORRENT_H_ */
@@ -18,6 +18,11 @@
  */
 
 #include "lvfs_bits_TorrentFile.h"
+#include "lvfs_bits_Torrent.h"
+#include "lvfs_bits_Session.h"
+#include "lvfs_bits_Hasher.h"
+#include "lvfs_bits_Trace.h"
+#include "lvfs_bits_Options.h"
 
 #include <lvfs/IEntry>
 #include <lvfs/IStream>
@@ -28,9 +33,17 @@
 #include <brolly/assert.h>
 
 #include <libtorrent/lazy_entry.hpp>
-#include <libtorrent/alert_types.hpp>
 #include <libtorrent/torrent_info.hpp>
-
+#include <libtorrent/create_torrent.hpp>
+#include <libtorrent/bencode.hpp>
+#include <libtorrent/file.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <mutex>
+#include <vector>
+#include <climits>
 #include <cstring>
 #include <cstdio>
 
@@ -39,149 +52,211 @@ namespace LVFS {
 namespace BitS {
 
 namespace {
-    class Stream : public Implements<IStream>
+    enum
     {
-    public:
-        enum
-        {
-            PokeTimeout = 100,
-            FillBufferTimeout = 1 * 60 * 1000
-        };
+        PokeTimeout = 100,
+        FillBufferTimeout = 1 * 60 * 1000,
 
-    public:
-        Stream(int index, const boost::shared_ptr<libtorrent::torrent_info> &ti, libtorrent::session &session) :
-            m_index(index),
-            m_pos(0),
-            m_session(session)
-        {
-            using namespace libtorrent;
-            error_code ec;
-            add_torrent_params p;
+        /* The default limit of 1M items is hit by torrents with ~200K files */
+        BDecodeDepthLimit = 1000,
+        BDecodeItemLimit = 100 * 1000 * 1000
+    };
 
-            p.save_path = "/tmp";
-            p.ti = ti;
 
-            libtorrent::torrent_handle h = m_session.add_torrent(p, ec);
+    static void addPieces(std::vector<int> &pieces, const libtorrent::torrent_info &ti, int index, off64_t offset, off64_t size)
+    {
+        const int first = ti.map_file(index, offset, 1).piece;
+        const int last = ti.map_file(index, offset + size - 1, 1).piece;
 
-            if (ec)
-                return;
+        for (int piece = first; piece <= last; ++piece)
+            pieces.push_back(piece);
+    }
 
-            m_torrent = std::move(h);
 
-            readAhead();
+    static bool prefetch(const boost::shared_ptr<Torrent> &torrent,
+                         const char *location,
+                         off64_t head,
+                         off64_t tail,
+                         IPrefetch::Callback *callback,
+                         Error &error)
+    {
+        using namespace libtorrent;
+
+        if (head < 0 || tail < 0)
+        {
+            error = Error(EINVAL);
+            return false;
         }
 
-        virtual ~Stream()
+        Session *session = Session::instance();
+
+        if (UNLIKELY(session == NULL))
         {
-            m_torrent.clear_piece_deadlines();
+            error = Error(EIO);
+            return false;
         }
 
-        bool isValid() const { return m_torrent.is_valid(); }
+        const boost::shared_ptr<torrent_info> &ti = torrent->info();
+        torrent_handle h = torrent->acquire(*session);
 
-    public: /* IStream */
-        virtual size_t read(void *buffer, size_t size)
+        if (!h.is_valid())
         {
-            using namespace libtorrent;
+            error = Error(EIO);
+            return false;
+        }
 
-            const peer_request request = m_torrent.torrent_file()->map_file(m_index, m_pos, m_torrent.torrent_file()->file_at(m_index).size - m_pos);
-            const size_t piece_length = m_torrent.torrent_file()->piece_length();
-            uint32_t time_left = FillBufferTimeout;
-            std::deque<alert *> alerts;
-            int piece = request.piece;
-            bool done;
+        /* Keeps the torrent in the session while waiting for the pieces */
+        struct Release
+        {
+            Session &session;
+            const torrent_handle &handle;
+            ~Release() { session.release(handle); }
+        } release = { *session, h };
+
+        /* Locations start with '/', paths of files in torrent_info do not */
+        const size_t len = ::strlen(location) - (*location == '/' ? 1 : 0);
+        const char *prefix = location + (*location == '/' ? 1 : 0);
+        std::vector<int> pieces;
+
+        for (int i = 0; i < ti->num_files(); ++i)
+        {
+            const file_entry file = ti->file_at(i);
+
+            if (file.pad_file || file.size == 0)
+                continue;
 
-            size = request.length > size ? size : request.length;
+            if (len > 0 && (file.path.compare(0, len, prefix) != 0 || file.path.size() <= len || file.path[len] != '/'))
+                continue;
 
-            for (size_t left_to_read = size; left_to_read > 0;)
+            if (head + tail >= file.size)
+                addPieces(pieces, *ti, i, 0, file.size);
+            else
             {
-                if (!m_torrent.have_piece(piece))
-                    if (time_left > 0)
-                        do
-                        {
-                            ::usleep(PokeTimeout * 1000);
-
-                            if ((time_left -= PokeTimeout) == 0)
-                            {
-                                m_pos += size -= left_to_read;
-                                return size;
-                            }
-                        }
-                        while (!m_torrent.have_piece(piece));
-                    else
-                    {
-                        m_pos += size -= left_to_read;
-                        return size;
-                    }
+                if (head > 0)
+                    addPieces(pieces, *ti, i, 0, head);
 
-                m_torrent.read_piece(piece);
+                if (tail > 0)
+                    addPieces(pieces, *ti, i, file.size - tail, tail);
+            }
+        }
 
-                for (done = false; !done;)
-                {
-                    if (!m_session.wait_for_alert(milliseconds(PokeTimeout)))
-                        do
-                            if (time_left > 0)
-                                time_left -= PokeTimeout;
-                            else
-                            {
-                                m_pos += size -= left_to_read;
-                                return size;
-                            }
-                        while (!m_session.wait_for_alert(milliseconds(PokeTimeout)));
-
-                    m_session.pop_alerts(&alerts);
-
-                    if (left_to_read > piece_length)
-                    {
-                        for (alert *a : alerts)
-                        {
-                            if (const read_piece_alert *read_alert = alert_cast<read_piece_alert>(a))
-                            {
-                                ASSERT(read_alert->piece == piece);
+        std::sort(pieces.begin(), pieces.end());
+        pieces.erase(std::unique(pieces.begin(), pieces.end()), pieces.end());
 
-                                ::memcpy(static_cast<char *>(buffer) + size - left_to_read,
-                                         read_alert->buffer.get() + (read_alert->piece == request.piece ? request.start : 0),
-                                         read_alert->piece == request.piece ? read_alert->size - request.start : read_alert->size);
+        const int total = pieces.size();
 
-                                ++piece;
-                                left_to_read -= piece_length;
-                                done = true;
-                            }
+        /*
+         * Without a callback nobody waits for the pieces, so their deadlines
+         * stay until they are downloaded or the torrent leaves the session.
+         */
+        for (int piece : pieces)
+            session->setDeadline(h, piece, PokeTimeout, true);
 
-                            delete a;
-                        }
+        if (callback == NULL)
+            return true;
 
-                        alerts.clear();
-                    }
-                    else
-                    {
-                        for (alert *a : alerts)
-                        {
-                            if (const read_piece_alert *read_alert = alert_cast<read_piece_alert>(a))
-                            {
-                                ASSERT(read_alert->piece == piece);
-
-                                ::memcpy(static_cast<char *>(buffer) + size - left_to_read,
-                                         read_alert->buffer.get() + (read_alert->piece == request.piece ? request.start : 0),
-                                         left_to_read);
-
-                                done = true;
-                            }
-
-                            delete a;
-                        }
-
-                        if (done)
-                        {
-                            m_pos += size;
-                            return size;
-                        }
-                        else
-                            alerts.clear();
-                    }
-                }
+        struct Deadlines
+        {
+            Session &session;
+            const torrent_handle &handle;
+            const std::vector<int> &pieces;
+            ~Deadlines() { for (int piece : pieces) session.resetDeadline(handle, piece); }
+        } deadlines = { *session, h, pieces };
+
+        for (uint32_t time_left = FillBufferTimeout;; time_left -= PokeTimeout)
+        {
+            const torrent_status status = h.status(torrent_handle::query_pieces);
+            int done = 0;
+
+            for (int piece : pieces)
+                if (status.pieces.get_bit(piece))
+                    ++done;
+
+            if (!callback->progress(done, total))
+            {
+                error = Error(ECANCELED);
+                return false;
             }
 
-            return 0;
+            if (done == total)
+                return true;
+
+            if (time_left == 0)
+            {
+                error = Error(ETIMEDOUT);
+                return false;
+            }
+
+            ::usleep(PokeTimeout * 1000);
+        }
+    }
+
+
+    class Stream : public Implements<IStream, IStatistics>
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+    public:
+        Stream(int index, const boost::shared_ptr<Torrent> &torrent, Session &session) :
+            m_index(index),
+            m_pos(0),
+            m_session(session),
+            m_data(torrent),
+            m_statistics(&session.statistics(torrent->info()->info_hash())),
+            m_torrent(torrent->acquire(session)),
+            m_cursor(0),
+            m_readAheadPiece(0),
+            m_firstDeadline(0),
+            m_lastDeadline(-1),
+            m_trace(Trace::instance()),
+            m_traceId(0)
+        {
+            if (m_torrent.is_valid())
+            {
+                if ((m_cache = m_session.cache(m_torrent)))
+                    m_cache->addCursor(m_cursor);
+
+                readAhead();
+            }
+
+            if (m_trace != NULL)
+                m_traceId = m_trace->open(m_data->info()->info_hash(),
+                                          m_index,
+                                          m_data->info()->file_at(m_index).size,
+                                          m_data->info()->piece_length(),
+                                          m_torrent.is_valid());
+        }
+
+        virtual ~Stream()
+        {
+            if (m_torrent.is_valid())
+            {
+                if (m_cache)
+                    m_cache->removeCursor(m_cursor);
+
+                if (m_trace != NULL)
+                    m_trace->close(m_traceId);
+
+                resetDeadlines(0, -1);
+                m_session.release(m_torrent);
+            }
+        }
+
+        bool isValid() const { return m_torrent.is_valid(); }
+
+    public: /* IStream */
+        virtual size_t read(void *buffer, size_t size)
+        {
+            if (m_trace == NULL)
+                return fill(buffer, size);
+
+            const Trace::Clock::time_point start = Trace::Clock::now();
+            const off64_t offset = m_pos;
+            const size_t res = fill(buffer, size);
+
+            m_trace->read(m_traceId, offset, size, res, start);
+            return res;
         }
 
         virtual size_t write(const void *buffer, size_t size)
@@ -191,10 +266,96 @@ namespace {
 
         virtual bool advise(off64_t offset, off64_t len, Advise advise)
         {
+            if (m_trace != NULL)
+                m_trace->advise(m_traceId, offset, len, advise, false);
+
             return false;
         }
 
         virtual bool seek(off64_t offset, Whence whence)
+        {
+            const bool res = move(offset, whence);
+
+            if (m_trace != NULL)
+                m_trace->seek(m_traceId, offset, whence, m_pos, res);
+
+            return res;
+        }
+
+        virtual bool flush()
+        {
+            return false;
+        }
+
+        virtual const Error &lastError() const
+        {
+            return m_lastError;
+        }
+
+    public: /* IStatistics */
+        virtual bool statistics(Snapshot &snapshot, Scope scope) const
+        {
+            switch (scope)
+            {
+                case StreamScope:
+                    m_statistics.snapshot(snapshot);
+                    break;
+
+                case TorrentScope:
+                    m_session.statistics(m_data->info()->info_hash()).snapshot(snapshot);
+                    Session::status(m_torrent, snapshot);
+                    break;
+
+                case SessionScope:
+                    Statistics::session().snapshot(snapshot);
+                    m_session.status(snapshot);
+                    break;
+
+                default:
+                    return false;
+            }
+
+            return true;
+        }
+
+    private:
+        size_t fill(void *buffer, size_t size)
+        {
+            using namespace libtorrent;
+
+            const off64_t file_size = m_data->info()->file_at(m_index).size;
+
+            if (m_pos >= file_size)
+                return 0;
+
+            const peer_request request = m_data->info()->map_file(m_index, m_pos, std::min<off64_t>(std::min<off64_t>(size, file_size - m_pos), INT_MAX));
+            uint32_t time_left = FillBufferTimeout;
+            boost::shared_array<char> data;
+            int data_size;
+            size_t done = 0;
+
+            for (int piece = request.piece, start = request.start; done < request.length; ++piece, start = 0)
+            {
+                if (!readPiece(piece, data, data_size, time_left))
+                    break;
+
+                const size_t len = std::min<size_t>(data_size - start, request.length - done);
+
+                ::memcpy(static_cast<char *>(buffer) + done, data.get() + start, len);
+                done += len;
+            }
+
+            m_pos += done;
+            m_statistics.read(done);
+
+            /* Slide the window of pieces kept in memory */
+            if (m_cache && m_pos < file_size && m_data->info()->map_file(m_index, m_pos, 1).piece != m_cursor)
+                readAhead();
+
+            return done;
+        }
+
+        bool move(off64_t offset, Whence whence)
         {
             switch (whence)
             {
@@ -202,7 +363,7 @@ namespace {
                 {
                     off64_t pos = offset;
 
-                    if (pos < 0 || pos > m_torrent.torrent_file()->file_at(m_index).size)
+                    if (pos < 0 || pos > m_data->info()->file_at(m_index).size)
                         return false;
                     else
                         m_pos = pos;
@@ -214,7 +375,7 @@ namespace {
                 {
                     off64_t pos = m_pos + offset;
 
-                    if (pos < 0 || pos > m_torrent.torrent_file()->file_at(m_index).size)
+                    if (pos < 0 || pos > m_data->info()->file_at(m_index).size)
                         return false;
                     else
                         m_pos = pos;
@@ -224,9 +385,9 @@ namespace {
 
                 case FromEnd:
                 {
-                    off64_t pos = m_torrent.torrent_file()->file_at(m_index).size - offset;
+                    off64_t pos = m_data->info()->file_at(m_index).size - offset;
 
-                    if (pos < 0 || pos > m_torrent.torrent_file()->file_at(m_index).size)
+                    if (pos < 0 || pos > m_data->info()->file_at(m_index).size)
                         return false;
                     else
                         m_pos = pos;
@@ -242,47 +403,134 @@ namespace {
             return true;
         }
 
-        virtual bool flush()
+        static uint32_t elapsed(const Clock::time_point &from, const Clock::time_point &to)
         {
-            return false;
+            return std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count();
         }
 
-        virtual const Error &lastError() const
+        bool readPiece(int piece, boost::shared_array<char> &data, int &size, uint32_t &time_left)
         {
-            return m_lastError;
+            bool ready = true;
+
+            for (;;)
+            {
+                const Clock::time_point requested = Clock::now();
+
+                while (!m_torrent.have_piece(piece))
+                    if (time_left == 0)
+                    {
+                        m_statistics.timeout();
+                        return false;
+                    }
+                    else
+                    {
+                        ready = false;
+                        ::usleep(PokeTimeout * 1000);
+
+                        /* Session::readPiece() leaves any number of milliseconds */
+                        time_left -= std::min<uint32_t>(time_left, PokeTimeout);
+                    }
+
+                const Clock::time_point downloaded = Clock::now();
+                const bool deadline_missed = !ready && piece >= m_readAheadPiece &&
+                        downloaded > m_readAheadTime + std::chrono::milliseconds(PokeTimeout + piece - m_readAheadPiece);
+
+                if (!m_session.readPiece(m_torrent, piece, data, size, time_left))
+                    if (m_cache && !m_cache->contains(piece))
+                    {
+                        /*
+                         * Going back to a piece dropped from memory. libtorrent 1.0 can not
+                         * forget a single piece, only a recheck makes it download it again.
+                         */
+                        m_torrent.clear_error();
+                        m_torrent.force_recheck();
+                        m_torrent.resume();
+                        readAhead();
+                        continue;
+                    }
+                    else
+                    {
+                        if (time_left == 0)
+                            m_statistics.timeout();
+
+                        return false;
+                    }
+
+                m_statistics.piece(ready, elapsed(requested, downloaded), elapsed(downloaded, Clock::now()), deadline_missed);
+
+                if (m_session.verify(m_torrent, *m_data->info(), piece, data.get(), size))
+                    return true;
+            }
         }
 
-    private:
         void readAhead()
         {
             using namespace libtorrent;
 
-            peer_request request = m_torrent.torrent_file()->map_file(m_index, m_pos, m_torrent.torrent_file()->file_at(m_index).size - m_pos);
-            const size_t piece_length = m_torrent.torrent_file()->piece_length();
+            peer_request request = m_data->info()->map_file(m_index, m_pos, m_data->info()->file_at(m_index).size - m_pos);
+            const size_t piece_length = m_data->info()->piece_length();
             int piece = request.piece;
             int deadline = PokeTimeout;
 
-            m_torrent.clear_piece_deadlines();
+            m_readAheadPiece = piece;
+            m_readAheadTime = Clock::now();
+
+            if (m_cache)
+            {
+                m_cache->moveCursor(m_cursor, piece);
+                m_cursor = piece;
+
+                /* Only as much as fits into memory */
+                request.length = std::min<off64_t>(request.length, std::max(m_cache->window(), piece_length));
+            }
+
+            const int first = piece;
+            int last = first - 1;
+
+            for (; request.length > 0; ++piece, ++deadline)
+            {
+                /* A reference is taken once per piece this stream did not have yet */
+                m_session.setDeadline(m_torrent, last = piece, deadline, piece < m_firstDeadline || piece > m_lastDeadline);
 
-            for (; request.length > 0;)
                 if (request.length > piece_length)
-                {
-                    m_torrent.set_piece_deadline(piece++, deadline++);
                     request.length -= piece_length;
-                }
                 else
-                {
-                    m_torrent.set_piece_deadline(piece, deadline);
                     break;
-                }
+            }
+
+            resetDeadlines(first, last);
+        }
+
+        /*
+         * Pieces of this stream now out of [first, last] are released, Session
+         * resets their deadlines unless other streams or prefetches need them.
+         */
+        void resetDeadlines(int first, int last)
+        {
+            for (int piece = m_firstDeadline; piece <= m_lastDeadline; ++piece)
+                if (piece < first || piece > last)
+                    m_session.resetDeadline(m_torrent, piece);
+
+            m_firstDeadline = first;
+            m_lastDeadline = last;
         }
 
     private:
         int m_index;
         off64_t m_pos;
         mutable Error m_lastError;
-        libtorrent::session &m_session;
+        Session &m_session;
+        boost::shared_ptr<Torrent> m_data;
+        Statistics m_statistics;
         libtorrent::torrent_handle m_torrent;
+        boost::shared_ptr<MemoryStorage::Cache> m_cache;
+        int m_cursor;
+        int m_readAheadPiece;
+        int m_firstDeadline;
+        int m_lastDeadline;
+        Clock::time_point m_readAheadTime;
+        Trace *m_trace;
+        uint32_t m_traceId;
     };
 
 
@@ -293,15 +541,13 @@ namespace {
               off64_t size,
               time_t ctime,
               int index,
-              const boost::shared_ptr<libtorrent::torrent_info> &ti,
-              libtorrent::session &session) :
+              const boost::shared_ptr<Torrent> &torrent) :
             m_location(::strdup(location)),
             m_title(::strrchr(m_location, '/') + 1),
             m_size(size),
             m_ctime(ctime),
-            m_session(session),
             m_index(index),
-            m_ti(ti)
+            m_torrent(torrent)
         {
             m_type = Module::desktop().typeOfFile(m_title);
         }
@@ -318,7 +564,18 @@ namespace {
         virtual const IType *type() const { return m_type; }
         virtual Interface::Holder open(IStream::Mode mode) const
         {
-            Interface::Holder res(new (std::nothrow) Stream(m_index, m_ti, m_session));
+            /* Networking starts only when some file is really opened */
+            Session *session = Session::instance();
+
+            if (UNLIKELY(session == NULL))
+            {
+                if (Trace *trace = Trace::instance())
+                    trace->open(m_torrent->info()->info_hash(), m_index, m_size, m_torrent->info()->piece_length(), false);
+
+                return Interface::Holder();
+            }
+
+            Interface::Holder res(new (std::nothrow) Stream(m_index, m_torrent, *session));
 
             if (LIKELY(res.isValid() == true))
                 if (res.as<Stream>()->isValid())
@@ -343,18 +600,19 @@ namespace {
 
     private:
         int m_index;
-        libtorrent::session &m_session;
-        boost::shared_ptr<libtorrent::torrent_info> m_ti;
+        boost::shared_ptr<Torrent> m_torrent;
     };
 
 
-    class Dir : public Implements<IEntry, IDirectory>
+    class Dir : public Implements<IEntry, IDirectory, IPrefetch>
     {
     public:
-        Dir(const char *location) :
+        Dir(const char *location,
+            const boost::shared_ptr<Torrent> &torrent) :
             m_location(::strdup(location)),
             m_title(::strrchr(m_location, '/') + 1),
-            m_type(Module::desktop().typeOfDirectory())
+            m_type(Module::desktop().typeOfDirectory()),
+            m_torrent(torrent)
         {}
 
         virtual ~Dir()
@@ -388,12 +646,21 @@ namespace {
 
         virtual const Error &lastError() const { return m_error; }
 
+    public: /* IPrefetch */
+        virtual bool prefetch(off64_t head, off64_t tail, Callback *callback = NULL)
+        {
+            return BitS::prefetch(m_torrent, m_location, head, tail, callback, m_error);
+        }
+
     private:
         char *m_location;
         const char *m_title;
         TorrentFile::Files m_entries;
         Interface::Adaptor<IType> m_type;
         mutable Error m_error;
+
+    private:
+        boost::shared_ptr<Torrent> m_torrent;
     };
 
 
@@ -402,8 +669,7 @@ namespace {
         time_t cTime;
         time_t creation_date;
         TorrentFile::Files files;
-        libtorrent::session *session;
-        boost::shared_ptr<libtorrent::torrent_info> ti;
+        boost::shared_ptr<Torrent> torrent;
     };
 
 
@@ -427,7 +693,7 @@ namespace {
         if (::snprintf(state.location + sizeof(state.location) - len, len, "/%s", state.name.c_str()) >= len)
             return false;
 
-        entry.reset(new (std::nothrow) Entry(state.location, state.length, state.ctime, state.index++, state.global.ti, *state.global.session));
+        entry.reset(new (std::nothrow) Entry(state.location, state.length, state.ctime, state.index++, state.global.torrent));
 
         if (UNLIKELY(entry.isValid() == false))
             return false;
@@ -441,54 +707,84 @@ namespace {
     }
 
 
+    static inline bool equal(const libtorrent::lazy_entry *a, const libtorrent::lazy_entry *b)
+    {
+        return a->string_length() == b->string_length() && ::memcmp(a->string_ptr(), b->string_ptr(), a->string_length()) == 0;
+    }
+
+
     static bool processFiles(TorrentFile::Files *entries, const libtorrent::lazy_entry &files, ProcessEntryState &state, const char *path_buf)
     {
+        struct Level
+        {
+            const libtorrent::lazy_entry *name;
+            TorrentFile::Files *entries;
+            size_t length;
+        };
+
         Interface::Holder entry;
         TorrentFile::Files *local_entries;
+        std::vector<Level> levels;
+        const size_t base_length = ::strlen(path_buf);
 
         const libtorrent::lazy_entry *path;
         const libtorrent::lazy_entry *current_file;
 
+        ::strcpy(state.location, path_buf);
+
+        /*
+         * Files of a directory usually go one after another, so directories
+         * of the previous file are reused as long as the paths have them in common.
+         */
         for (int i = 0; i < files.list_size(); ++i)
         {
             path = files.list_at(i)->dict_find("path");
-            current_file = path->list_at(0);
 
-            local_entries = entries;
-            ::strcpy(state.location, path_buf);
+            const int depth = path->list_size() - 1;
+            int q = 0;
+
+            for (; q < depth && q < levels.size() && equal(levels[q].name, path->list_at(q)); ++q)
+                continue;
+
+            levels.resize(q);
+            local_entries = levels.empty() ? entries : levels.back().entries;
+            char *local_buf = state.location + (levels.empty() ? base_length : levels.back().length);
 
-            if (path->list_size() > 1)
+            for (; q < depth; ++q)
             {
-                char *local_buf = state.location + strlen(state.location);
+                current_file = path->list_at(q);
 
-                for (int q = 0; q < path->list_size() - 1; ++q, current_file = path->list_at(q))
-                {
-                    if (::snprintf(local_buf,
-                                   sizeof(state.location) - (local_buf - state.location),
-                                   "/%s",
-                                   current_file->string_cstr()) >= sizeof(state.location) - (local_buf - state.location))
-                        return false;
+                if (::snprintf(local_buf,
+                               sizeof(state.location) - (local_buf - state.location),
+                               "/%s",
+                               current_file->string_cstr()) >= sizeof(state.location) - (local_buf - state.location))
+                    return false;
 
-                    local_buf += current_file->string_length() + 1;
+                local_buf += current_file->string_length() + 1;
 
-                    EFC::String key(current_file->string_cstr());
-                    TorrentFile::Files::iterator lb = local_entries->lower_bound(key);
+                EFC::String key(current_file->string_cstr());
+                TorrentFile::Files::iterator lb = local_entries->lower_bound(key);
 
-                    if (lb != local_entries->end() && !(local_entries->key_comp()(key, lb->first)))
-                        local_entries = lb->second.as<Dir>()->entries();
-                    else
-                    {
-                        entry.reset(new (std::nothrow) Dir(state.location));
+                if (lb != local_entries->end() && !(local_entries->key_comp()(key, lb->first)))
+                    local_entries = lb->second.as<Dir>()->entries();
+                else
+                {
+                    entry.reset(new (std::nothrow) Dir(state.location, state.global.torrent));
 
-                        if (UNLIKELY(entry.isValid() == false))
-                            return false;
+                    if (UNLIKELY(entry.isValid() == false))
+                        return false;
 
-                        local_entries->insert(lb, TorrentFile::Files::value_type(key, entry));
-                        local_entries = entry.as<Dir>()->entries();
-                    }
+                    local_entries->insert(lb, TorrentFile::Files::value_type(key, entry));
+                    local_entries = entry.as<Dir>()->entries();
                 }
+
+                Level level = { current_file, local_entries, static_cast<size_t>(local_buf - state.location) };
+                levels.push_back(level);
             }
 
+            *local_buf = 0;
+            current_file = path->list_at(depth);
+
             state.name = current_file->string_cstr();
             state.length = files.list_at(i)->dict_find("length")->int_value();
 
@@ -523,7 +819,7 @@ namespace {
             if (::snprintf(buf, sizeof(buf), "/%s", name->string_cstr()) >= sizeof(buf))
                 return false;
 
-            Interface::Holder entry(new (std::nothrow) Dir(buf));
+            Interface::Holder entry(new (std::nothrow) Dir(buf, state.global.torrent));
 
             if (UNLIKELY(entry.isValid() == false))
                 return false;
@@ -574,31 +870,33 @@ TorrentFile::const_iterator TorrentFile::begin() const
                     libtorrent::lazy_entry e;
                     libtorrent::error_code ec;
 
-                    if (libtorrent::lazy_bdecode(buffer.get(), buffer.get() + len, e, ec) == 0)
+                    if (libtorrent::lazy_bdecode(buffer.get(), buffer.get() + len, e, ec, NULL, BDecodeDepthLimit, BDecodeItemLimit) == 0)
                     {
-                        libtorrent::error_code ec;
+                        GlobalState state;
+                        boost::shared_ptr<libtorrent::torrent_info> ti(new (std::nothrow) libtorrent::torrent_info(e, ec));
 
-                        m_session.listen_on(std::make_pair(50001, 50001), ec);
+                        if (UNLIKELY(ti.get() == NULL))
+                            return std_iterator<Files>(m_files.begin());
 
-                        if (ec)
+                        if (UNLIKELY(ti->is_valid() == false))
                             return std_iterator<Files>(m_files.begin());
 
-                        GlobalState state;
+                        /* Data of the torrent may already be in the directory of the .torrent file */
+                        const IEntry *file = original()->as<IEntry>();
+                        const std::string local_path = Options::instance().localData.value() && ::strcmp(file->schema(), "file") == 0 ?
+                                libtorrent::parent_path(file->location()) : std::string();
 
                         state.cTime = prop->cTime();
-                        state.session = &m_session;
-                        state.ti.reset(new (std::nothrow) libtorrent::torrent_info(e, ec));
-
-                        if (UNLIKELY(state.ti.get() == NULL))
-                            return std_iterator<Files>(m_files.begin());
+                        state.torrent.reset(new (std::nothrow) Torrent(ti, local_path));
 
-                        if (UNLIKELY(state.ti->is_valid() == false))
+                        if (UNLIKELY(state.torrent.get() == NULL))
                             return std_iterator<Files>(m_files.begin());
 
                         if (!processFile(state, e))
                             return std_iterator<Files>(m_files.begin());
 
                         m_files = std::move(state.files);
+                        m_torrent = std::move(state.torrent);
                     }
                 }
             }
@@ -624,7 +922,119 @@ Interface::Holder TorrentFile::entry(const char *name, const IType *type, bool c
 
 bool TorrentFile::copy(const Progress &callback, const Interface::Holder &file, bool move)
 {
-    return false;
+    using namespace libtorrent;
+
+    /* Only an empty .torrent file can be made from a local file or directory */
+    IProperties *prop = original()->as<IProperties>();
+    IEntry *source = file->as<IEntry>();
+
+    if (move || prop == NULL || source == NULL || ::strcmp(source->schema(), "file") != 0)
+    {
+        m_lastError = Error(EROFS);
+        return false;
+    }
+
+    if (prop->size() != 0)
+    {
+        m_lastError = Error(EEXIST);
+        return false;
+    }
+
+    file_storage fs;
+    add_files(fs, source->location());
+
+    if (fs.num_files() == 0)
+    {
+        m_lastError = Error(ENOENT);
+        return false;
+    }
+
+    class Hashes : public Hasher::Callback
+    {
+    public:
+        Hashes(const file_storage &files, const Progress &callback) :
+            m_files(files),
+            m_callback(callback),
+            m_hashes(files.num_pieces())
+        {}
+
+        const sha1_hash &at(int index) const { return m_hashes[index]; }
+
+        virtual bool piece(int index, const sha1_hash &hash)
+        {
+            m_hashes[index] = hash;
+
+            /* Progress is not expected to be called from several threads at once */
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_callback.update(m_files.piece_size(index));
+
+            return !m_callback.isAborted();
+        }
+
+    private:
+        const file_storage &m_files;
+        const Progress &m_callback;
+        std::mutex m_mutex;
+        std::vector<sha1_hash> m_hashes;
+    };
+
+    create_torrent ct(fs);
+    const std::string save_path = parent_path(source->location());
+    Hashes hashes(ct.files(), callback);
+    Hasher hasher(ct.files(), save_path);
+
+    callback.init(file);
+
+    if (!hasher.hash(0, ct.num_pieces(), hashes))
+    {
+        m_lastError = hasher.lastError();
+        return false;
+    }
+
+    callback.complete(file);
+
+    for (int i = 0; i < ct.num_pieces(); ++i)
+        ct.set_hash(i, hashes.at(i));
+
+    std::vector<char> buffer;
+    bencode(std::back_inserter(buffer), ct.generate());
+
+    Interface::Holder fp = original()->as<IEntry>()->open(IStream::Write);
+
+    if (!fp.isValid())
+    {
+        m_lastError = original()->as<IEntry>()->lastError();
+        return false;
+    }
+
+    if (fp->as<IStream>()->write(buffer.data(), buffer.size()) != buffer.size() || !fp->as<IStream>()->flush())
+    {
+        m_lastError = fp->as<IStream>()->lastError();
+        return false;
+    }
+
+    fp.reset();
+    m_files.clear();
+    m_torrent.reset();
+    begin();
+
+    if (m_torrent.get() == NULL)
+    {
+        m_lastError = Error(EIO);
+        return false;
+    }
+
+    /* The data has just been hashed, so start seeding it right away */
+    Torrent torrent(m_torrent->info(), save_path);
+    Session *session = Session::instance();
+
+    if (session == NULL || !torrent.acquire(*session, true).is_valid())
+    {
+        m_lastError = Error(EIO);
+        return false;
+    }
+
+    return true;
 }
 
 bool TorrentFile::rename(const Interface::Holder &file, const char *name)
@@ -642,4 +1052,48 @@ const Error &TorrentFile::lastError() const
     return m_lastError;
 }
 
+bool TorrentFile::statistics(Snapshot &snapshot, Scope scope) const
+{
+    begin();
+
+    if (m_torrent.get() == NULL)
+    {
+        m_lastError = Error(ENOENT);
+        return false;
+    }
+
+    /* Statistics must not start the session */
+    Session *session = Session::current();
+
+    if (scope == SessionScope)
+    {
+        Statistics::session().snapshot(snapshot);
+
+        if (session != NULL)
+            session->status(snapshot);
+    }
+    else if (session != NULL)
+    {
+        session->statistics(m_torrent->info()->info_hash()).snapshot(snapshot);
+        session->status(m_torrent->info()->info_hash(), snapshot);
+    }
+    else
+        ::memset(&snapshot, 0, sizeof(snapshot));
+
+    return true;
+}
+
+bool TorrentFile::prefetch(off64_t head, off64_t tail, Callback *callback)
+{
+    begin();
+
+    if (m_torrent.get() == NULL)
+    {
+        m_lastError = Error(ENOENT);
+        return false;
+    }
+
+    return BitS::prefetch(m_torrent, "", head, tail, callback, m_lastError);
+}
+
 }}
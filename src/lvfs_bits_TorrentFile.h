@@ -23,13 +23,19 @@
 #include <efc/Map>
 #include <efc/String>
 #include <lvfs/IDirectory>
-#include <libtorrent/session.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "lvfs_bits_IPrefetch.h"
+#include "lvfs_bits_IStatistics.h"
 
 
 namespace LVFS {
 namespace BitS {
 
-class PLATFORM_MAKE_PRIVATE TorrentFile : public ExtendsBy<IDirectory>
+class Torrent;
+
+
+class PLATFORM_MAKE_PRIVATE TorrentFile : public ExtendsBy<IDirectory, IPrefetch, IStatistics>
 {
 public:
     typedef EFC::Map<EFC::String, Interface::Holder> Files;
@@ -51,10 +57,16 @@ public: /* IDirectory */
 
     virtual const Error &lastError() const;
 
+public: /* IStatistics */
+    virtual bool statistics(Snapshot &snapshot, Scope scope) const;
+
+public: /* IPrefetch */
+    virtual bool prefetch(off64_t head, off64_t tail, Callback *callback = NULL);
+
 private:
     mutable Files m_files;
     mutable Error m_lastError;
-    mutable libtorrent::session m_session;
+    mutable boost::shared_ptr<Torrent> m_torrent;
 };
 
 }}
@@ -0,0 +1,136 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bits_Trace.h"
+#include "lvfs_bits_Options.h"
+
+#include <libtorrent/escape_string.hpp>
+
+#include <cinttypes>
+#include <random>
+
+#include <unistd.h>
+
+
+namespace LVFS {
+namespace BitS {
+
+namespace {
+    struct Holder
+    {
+        Holder() :
+            trace(NULL)
+        {}
+
+        ~Holder()
+        {
+            delete trace;
+        }
+
+        Trace *trace;
+    };
+}
+
+
+Trace *Trace::instance()
+{
+    static Holder holder;
+    static std::once_flag once;
+
+    std::call_once(once, []()
+    {
+        const char *name = Options::instance().trace.value();
+
+        if (name != NULL && *name != 0)
+            if (std::FILE *file = std::fopen(name, "w"))
+                holder.trace = new (std::nothrow) Trace(file);
+    });
+
+    return holder.trace;
+}
+
+uint32_t Trace::open(const libtorrent::sha1_hash &info_hash, int index, off64_t size, int piece_length, bool result)
+{
+    const uint32_t stream = ++m_streams;
+    const std::string hash = libtorrent::to_hex(info_hash.to_string());
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::fprintf(m_file, "%" PRIu64 " open %" PRIu32 " %s %d %" PRId64 " %d %d\n",
+                 time(Clock::now()), stream, hash.c_str(), index, static_cast<int64_t>(size), piece_length, result ? 1 : 0);
+
+    return stream;
+}
+
+void Trace::read(uint32_t stream, off64_t offset, size_t size, size_t result, const Clock::time_point &start)
+{
+    const Clock::time_point now = Clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::fprintf(m_file, "%" PRIu64 " read %" PRIu32 " %" PRId64 " %zu %zu %" PRIu64 "\n",
+                 time(start), stream, static_cast<int64_t>(offset), size, result, time(now) - time(start));
+}
+
+void Trace::seek(uint32_t stream, off64_t offset, int whence, off64_t position, bool result)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::fprintf(m_file, "%" PRIu64 " seek %" PRIu32 " %" PRId64 " %d %" PRId64 " %d\n",
+                 time(Clock::now()), stream, static_cast<int64_t>(offset), whence, static_cast<int64_t>(position), result ? 1 : 0);
+}
+
+void Trace::advise(uint32_t stream, off64_t offset, off64_t length, int advise, bool result)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::fprintf(m_file, "%" PRIu64 " advise %" PRIu32 " %" PRId64 " %" PRId64 " %d %d\n",
+                 time(Clock::now()), stream, static_cast<int64_t>(offset), static_cast<int64_t>(length), advise, result ? 1 : 0);
+}
+
+void Trace::close(uint32_t stream)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::fprintf(m_file, "%" PRIu64 " close %" PRIu32 "\n", time(Clock::now()), stream);
+    std::fflush(m_file);
+}
+
+Trace::Trace(std::FILE *file) :
+    m_file(file),
+    m_start(Clock::now()),
+    m_streams(0)
+{
+    std::random_device random;
+    const uint64_t run = (static_cast<uint64_t>(random()) << 32) | random();
+    const int64_t epoch = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::fprintf(m_file, "0 run %016" PRIx64 " %" PRId64 " %d\n", run, epoch, static_cast<int>(::getpid()));
+    std::fflush(m_file);
+}
+
+Trace::~Trace()
+{
+    std::fclose(m_file);
+}
+
+uint64_t Trace::time(const Clock::time_point &time) const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(time - m_start).count();
+}
+
+}}
@@ -0,0 +1,86 @@
+/**
+ * This file is part of lvfs-bits.
+ *
+ * Copyright (C) 2016 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs-bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs-bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs-bits. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BITS_TRACE_H_
+#define LVFS_BITS_TRACE_H_
+
+#include <lvfs/Interface>
+#include <libtorrent/peer_id.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <cstdio>
+
+
+namespace LVFS {
+namespace BitS {
+
+/**
+ * Recorder of stream accesses, enabled by setting Options::trace to
+ * the name of the trace file.
+ *
+ * The file is truncated when the first stream is opened, so it holds
+ * one run of one process. The first line identifies the run, epoch is
+ * the wall clock time of time 0 in microseconds since 1970. Every other
+ * line is one call, times are in microseconds since time 0 and streams
+ * are numbered from 1 in the order they are opened. Opens which failed
+ * have result 0 and no other lines:
+ *
+ *   0 run <run id> <epoch> <pid>
+ *   <time> open <stream> <info hash> <file index> <file size> <piece length> <result>
+ *   <time> read <stream> <offset> <size> <result> <duration>
+ *   <time> seek <stream> <offset> <whence> <position> <result>
+ *   <time> advise <stream> <offset> <length> <advise> <result>
+ *   <time> close <stream>
+ */
+class PLATFORM_MAKE_PRIVATE Trace
+{
+    PLATFORM_MAKE_NONCOPYABLE(Trace)
+    PLATFORM_MAKE_NONMOVEABLE(Trace)
+
+public:
+    typedef std::chrono::steady_clock Clock;
+
+public:
+    ~Trace();
+
+    static Trace *instance();
+
+    uint32_t open(const libtorrent::sha1_hash &info_hash, int index, off64_t size, int piece_length, bool result);
+    void read(uint32_t stream, off64_t offset, size_t size, size_t result, const Clock::time_point &start);
+    void seek(uint32_t stream, off64_t offset, int whence, off64_t position, bool result);
+    void advise(uint32_t stream, off64_t offset, off64_t length, int advise, bool result);
+    void close(uint32_t stream);
+
+private:
+    Trace(std::FILE *file);
+
+    uint64_t time(const Clock::time_point &time) const;
+
+private:
+    std::mutex m_mutex;
+    std::FILE *m_file;
+    Clock::time_point m_start;
+    std::atomic<uint32_t> m_streams;
+};
+
+}}
+
+#endif /* LVFS_BITS_TRACE_H_ */